@@ -0,0 +1,202 @@
+#include "BatchRenderer.h"
+
+#include <algorithm>
+#include <cstddef>
+
+
+/**
+ * @brief Releases the VAO of the vertex stream.
+ */
+BatchRenderer::~BatchRenderer() {
+    if (vao_ != 0)
+        glDeleteVertexArrays(1, &vao_);
+}
+
+
+/**
+ * @brief Makes room for count vertices in the stream.
+ *
+ * The VAO reads the position from attribute 0 and the color from attribute
+ * 1; when the stream recreates its buffer, the VAO is pointed to the new one.
+ *
+ * @param count The number of vertices needed.
+ */
+void BatchRenderer::reserve(const size_t count) {
+    if (vao_ == 0) {
+        glCreateVertexArrays(1, &vao_);
+        glEnableVertexArrayAttrib(vao_, 0);
+        glVertexArrayAttribFormat(vao_, 0, 2, GL_FLOAT, GL_FALSE,
+                                  offsetof(BatchVertex, position));
+        glVertexArrayAttribBinding(vao_, 0, 0);
+        glEnableVertexArrayAttrib(vao_, 1);
+        glVertexArrayAttribFormat(vao_, 1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                                  offsetof(BatchVertex, color));
+        glVertexArrayAttribBinding(vao_, 1, 0);
+    }
+    if (stream_.reserve(count))
+        glVertexArrayVertexBuffer(vao_, 0, stream_.buffer(), 0,
+                                  sizeof(BatchVertex));
+}
+
+
+/**
+ * @brief Queues a draw of vtx[0, count) for the next flush.
+ *
+ * The vertices are copied, so vtx may change right after the call.
+ *
+ * @param layer The drawing order: lower layers are drawn first, draws of the
+ * same layer in any order.
+ * @param type The primitive type, e.g. GL_LINE_STRIP.
+ * @param vtx The vertices, in model space.
+ * @param count The number of vertices.
+ * @param color The color of every vertex.
+ * @param size The line width of line primitives, the point size of points.
+ * @param M The model matrix applied to the vertices.
+ */
+void BatchRenderer::submit(const int layer, const int type, const vec2* vtx,
+                           const size_t count, const vec3 color,
+                           const float size, const mat4& M) {
+    if (count == 0)
+        return;
+
+    const uint32_t packed = packColor(color);
+    const size_t first = vertices_.size();
+    vertices_.resize(first + count);
+    BatchVertex* out = vertices_.data() + first;
+    if (M == mat4(1.0f)) {
+        for (size_t i = 0; i < count; i++)
+            out[i] = {vtx[i], packed};
+    } else {
+        for (size_t i = 0; i < count; i++)
+            out[i] = {vec2(M * vec4(vtx[i], 0, 1)), packed};
+    }
+    commands_.push_back({layer, type, size, first, count});
+}
+
+
+/**
+ * @brief Draws and clears the queued draws.
+ *
+ * See upload for the order of the draws.
+ *
+ * @param shader The GPU program with per-vertex colors used for rendering;
+ * its MVP uniform is set.
+ * @param MVP The model-view-projection matrix of the scene.
+ */
+void BatchRenderer::flush(GPUProgram* shader, const mat4& MVP) {
+    ProfileZone zone("BatchRenderer::flush", true);
+    upload();
+    shader->setUniform(MVP, shader->uniform("MVP"));
+    draw();
+    endDraws();
+}
+
+
+/**
+ * @brief Writes the queued draws into the stream and clears them.
+ *
+ * The draws are stably sorted by layer, primitive type and size. The vertices
+ * of every group of equal state are written next to each other into the next
+ * region of the stream, and each group becomes one glMultiDrawArrays of
+ * draw. Consecutive point, line and triangle lists are merged into a single
+ * range.
+ */
+void BatchRenderer::upload() {
+    groups_.clear();
+    firsts_.clear();
+    counts_.clear();
+    submissions_ = 0;
+    if (commands_.empty())
+        return;
+
+    order_.resize(commands_.size());
+    for (size_t i = 0; i < order_.size(); i++)
+        order_[i] = i;
+    std::stable_sort(order_.begin(), order_.end(),
+                     [this](const size_t a, const size_t b) {
+                         const Command& p = commands_[a];
+                         const Command& q = commands_[b];
+                         if (p.layer != q.layer)
+                             return p.layer < q.layer;
+                         if (p.type != q.type)
+                             return p.type < q.type;
+                         return p.size < q.size;
+                     });
+
+    reserve(vertices_.size());
+    BatchVertex* const out = stream_.beginWrite(vertices_.size());
+    if (out != nullptr) {
+        const int base = stream_.first();
+        size_t written = 0;
+        for (size_t g = 0; g < order_.size();) {
+            const Command& first = commands_[order_[g]];
+            const bool list = first.type == GL_POINTS ||
+                              first.type == GL_LINES ||
+                              first.type == GL_TRIANGLES;
+            Group group{first.type, first.size, firsts_.size(), 0};
+
+            for (; g < order_.size(); g++) {
+                const Command& c = commands_[order_[g]];
+                if (c.layer != first.layer || c.type != first.type ||
+                    c.size != first.size)
+                    break;
+                std::copy_n(vertices_.data() + c.first, c.count,
+                            out + written);
+                const GLint start = base + static_cast<GLint>(written);
+                const GLsizei count = static_cast<GLsizei>(c.count);
+                if (list && group.ranges > 0 &&
+                    firsts_.back() + counts_.back() == start)
+                    counts_.back() += count;
+                else {
+                    firsts_.push_back(start);
+                    counts_.push_back(count);
+                    group.ranges++;
+                }
+                written += c.count;
+            }
+            groups_.push_back(group);
+        }
+        submissions_ = static_cast<int>(groups_.size());
+    }
+    commands_.clear();
+    vertices_.clear();
+}
+
+
+/**
+ * @brief Draws the region written by the last upload.
+ *
+ * May be called several times per upload, e.g. once per view, with the
+ * bound program's MVP set by the caller or read from a uniform block.
+ */
+void BatchRenderer::draw() const {
+    if (groups_.empty())
+        return;
+    glBindVertexArray(vao_);
+    for (const Group& group : groups_) {
+        if (group.type == GL_POINTS)
+            glPointSize(group.size);
+        else if (group.type == GL_LINES || group.type == GL_LINE_LOOP ||
+                 group.type == GL_LINE_STRIP)
+            glLineWidth(group.size);
+        glMultiDrawArrays(group.type, firsts_.data() + group.range,
+                          counts_.data() + group.range,
+                          static_cast<GLsizei>(group.ranges));
+    }
+}
+
+
+/**
+ * @brief Marks the uploaded region as read by the draws issued so far, see
+ * StreamGeometry::endDraws. Called after the last draw of an upload.
+ */
+void BatchRenderer::endDraws() {
+    if (!groups_.empty())
+        stream_.endDraws();
+}
+
+
+/**
+ * @return The number of draw calls per draw of the last upload or flush.
+ */
+int BatchRenderer::submissions() const { return submissions_; }
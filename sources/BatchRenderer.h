@@ -0,0 +1,92 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include "Camera.h" // framework.h
+
+
+// Layers of the scene in drawing order, see BatchRenderer::submit
+enum BatchLayer {
+    CurveLayer,
+    ControlPointLayer,
+    BodyLayer,
+    OutlineLayer,
+    MarkerLayer
+};
+
+
+// Vertex of the merged stream of BatchRenderer
+struct BatchVertex {
+    vec2 position;
+    uint32_t color; // RGBA8
+};
+
+
+/**
+ * @class BatchRenderer
+ * @brief Collects the draws of a frame and submits them in a few calls.
+ *
+ * Objects submit their primitives with a layer, a color and a line width or
+ * point size instead of drawing them. flush sorts the queued draws by layer,
+ * primitive type and size, writes all of their vertices with per-vertex
+ * colors into one StreamGeometry and issues a single glMultiDrawArrays per
+ * group of equal state. Lower layers are drawn first.
+ *
+ * flush is upload, draw and endDraws in one. Several views of a frame call
+ * upload once and then draw once per view, which replays the same region of
+ * the stream, and endDraws after the last view.
+ */
+class BatchRenderer {
+
+    struct Command {
+        int layer;
+        int type;
+        float size;
+        size_t first, count; // in vertices_
+    };
+
+    // Draw call of the uploaded region: firsts_ and counts_ [range, range +
+    // ranges)
+    struct Group {
+        int type;
+        float size;
+        size_t range, ranges;
+    };
+
+    std::vector<Command> commands_;
+    std::vector<Group> groups_;
+    std::vector<BatchVertex> vertices_;
+    StreamGeometry<BatchVertex> stream_;
+    unsigned int vao_ = 0;
+    int submissions_ = 0;
+
+    // Scratch arrays of flush
+    std::vector<size_t> order_;
+    std::vector<GLint> firsts_;
+    std::vector<GLsizei> counts_;
+
+    void reserve(size_t count);
+
+  public:
+    BatchRenderer() = default;
+
+    ~BatchRenderer();
+
+    BatchRenderer(const BatchRenderer&) = delete;
+    BatchRenderer& operator=(const BatchRenderer&) = delete;
+
+    void submit(int layer, int type, const vec2* vtx, size_t count, vec3 color,
+                float size = 1.0f, const mat4& M = mat4(1.0f));
+
+    void flush(GPUProgram* shader, const mat4& MVP);
+
+    void upload();
+
+    void draw() const;
+
+    void endDraws();
+
+    int submissions() const;
+};
+
+
+#endif // BATCHRENDERER_H
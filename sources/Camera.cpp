@@ -17,6 +17,44 @@ Camera::Camera(const vec2 center, const vec2 size)
     : wCenter(center), wSize(size) {}
 
 
+/**
+ * @brief Scales the size of the viewed world region around its center.
+ *
+ * @param factor The scale factor; values below 1 zoom in, above 1 zoom out.
+ */
+void Camera::zoom(const float factor) { wSize = wSize * factor; }
+
+
+/**
+ * @brief Moves the viewed world region, keeping its size.
+ *
+ * @param center The new center of the viewed world region.
+ */
+void Camera::setCenter(const vec2 center) { wCenter = center; }
+
+
+/**
+ * @return The center of the viewed world region.
+ */
+vec2 Camera::getCenter() const { return wCenter; }
+
+
+/**
+ * @return The width and height of the viewed world region.
+ */
+vec2 Camera::getSize() const { return wSize; }
+
+
+/**
+ * @brief Gets the viewed world region, e.g. for culling against it.
+ *
+ * @return The rectangle centered at wCenter with the extent wSize.
+ */
+WorldRect Camera::worldRect() const {
+    return {wCenter - wSize * 0.5f, wCenter + wSize * 0.5f};
+}
+
+
 /**
  * @brief Computes the view matrix for the camera in world space.
  *
@@ -113,6 +151,21 @@ vec2 Camera::pixelToWorld(const vec2 pixelPos, const vec2 windowSize) const {
     const float ndcY = 1.0f - 2.0f * pixelPos.y / windowSize.y;
     const vec4 clipSpace(ndcX, ndcY, 0, 1);
     const vec4 world =
-        projectionMatrixInverse() * viewMatrixInverse() * clipSpace;
+        viewMatrixInverse() * projectionMatrixInverse() * clipSpace;
     return vec2(world.x, world.y);
 }
+
+
+/**
+ * @brief Computes the size of one screen pixel in world units.
+ *
+ * The larger of the horizontal and vertical pixel extents is returned, so a
+ * distance below this value is never visible on screen.
+ *
+ * @param windowSize A vec2 representing the size of the window in pixel space.
+ *
+ * @return The world-space size of a pixel.
+ */
+float Camera::pixelSize(const vec2 windowSize) const {
+    return std::max(wSize.x / windowSize.x, wSize.y / windowSize.y);
+}
@@ -5,6 +5,24 @@
 #include "framework.h"
 
 
+/**
+ * @struct WorldRect
+ * @brief Axis-aligned rectangle in world coordinates.
+ */
+struct WorldRect {
+    vec2 min, max;
+
+    bool overlaps(const WorldRect& other) const {
+        return min.x <= other.max.x && other.min.x <= max.x &&
+               min.y <= other.max.y && other.min.y <= max.y;
+    }
+
+    WorldRect expanded(const float margin) const {
+        return {min - vec2(margin, margin), max + vec2(margin, margin)};
+    }
+};
+
+
 /**
  * @class Camera
  * @brief Represents a 2D camera that provides transformations between world
@@ -24,6 +42,16 @@ class Camera {
   public:
     Camera(vec2 center, vec2 size);
 
+    void zoom(float factor);
+
+    void setCenter(vec2 center);
+
+    vec2 getCenter() const;
+
+    vec2 getSize() const;
+
+    WorldRect worldRect() const;
+
     mat4 viewMatrix() const;
 
     mat4 projectionMatrix() const;
@@ -35,6 +63,8 @@ class Camera {
     mat4 viewProjectionMatrix() const;
 
     vec2 pixelToWorld(vec2 pixelPos, vec2 windowSize) const;
+
+    float pixelSize(vec2 windowSize) const;
 };
 
 
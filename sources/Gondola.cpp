@@ -1,5 +1,8 @@
 #include "Gondola.h"
 
+#include <algorithm>
+#include <cmath>
+
 
 /**
  * @brief Constructs a Gondola object and initializes its geometry and state.
@@ -9,55 +12,46 @@
  * It also initializes internal variables such as progress along the spline,
  * velocity, energy, position, and rotation angle.
  *
+ * The mesh is only built for a renderable spline, see Spline::isRenderable,
+ * so a gondola on a headless spline needs no GL context either.
+ *
  * @param spline Pointer to a Spline object used by the Gondola for its path.
  * @return*/
 Gondola::Gondola(Spline* spline)
-    : spline_(spline), progressAlongSpline_(0), velocity_(0), energy_(0),
-      position_(vec2(0, 0)), rotationAngle_(0), state_(Waiting) {
-    constexpr int N = 32;
-    body_.Vtx().push_back(vec2(0, 0));
-
-    for (int i = 0; i <= N; i++) {
-        const float theta = i * 2.0f * M_PI / N;
-        body_.Vtx().push_back(
-            vec2(gondolaRadius_ * cos(theta), gondolaRadius_ * sin(theta)));
-    }
-
-    body_.updateGPU();
-
-    spokes_.Vtx() = {vec2(-1, 0), vec2(1, 0), vec2(0, -1), vec2(0, 1)};
-    spokes_.updateGPU();
+    : spline_(spline), progressAlongSpline_(0), distanceAlongSpline_(0),
+      velocity_(0), energy_(0), segmentHint_(0), distanceHint_(0),
+      position_(vec2(0, 0)), rotationAngle_(0), previousPosition_(vec2(0, 0)),
+      previousRotationAngle_(0), state_(Waiting) {
+    if (spline_->isRenderable())
+        buildMesh(mesh_, gondolaRadius_);
 }
 
 
 /**
- * Calculates the first derivative of the spline at a given parameter value.
+ * @brief Builds and uploads the gondola mesh.
  *
- * Uses a finite difference method with small step `h` to approximate the
- * derivative.
+ * The body, its rim and the spokes share a single vertex buffer, see the
+ * bodyFirst, rimFirst and spokesFirst ranges. The body is a triangle fan
+ * around the origin whose vertices after the center form the rim, and the
+ * spokes are two crossing lines.
  *
- * @param t The parameter value at which the derivative is calculated.
- * @return The first derivative of the spline as a 2D vector.
+ * @param mesh The geometry receiving the mesh.
+ * @param radius The radius of the gondola.
  */
-vec2 Gondola::derivative(const float t) const {
-    constexpr float h = 0.001f;
-    return (spline_->evaluate(t + h) - spline_->evaluate(t - h)) / (2.0f * h);
-}
+void Gondola::buildMesh(Geometry<vec2>& mesh, const float radius) {
+    constexpr int N = meshSegments;
+    std::vector<vec2>& vtx = mesh.Vtx();
+    vtx.clear();
+    vtx.push_back(vec2(0, 0));
 
+    for (int i = 0; i <= N; i++) {
+        const float theta = i * 2.0f * M_PI / N;
+        vtx.push_back(vec2(radius * cos(theta), radius * sin(theta)));
+    }
 
-/**
- * Calculates the second derivative of the spline function at a given parameter
- * value.
- *
- * @param t The parameter value at which to evaluate the second derivative.
- * @return The second derivative of the spline at the specified parameter value
- * as a vec2.
- */
-vec2 Gondola::secondDerivative(const float t) const {
-    constexpr float h = 0.001f;
-    return (spline_->evaluate(t + h) - 2.0f * spline_->evaluate(t) +
-            spline_->evaluate(t - h)) /
-           (h * h);
+    vtx.insert(vtx.end(), {vec2(-radius, 0), vec2(radius, 0),
+                           vec2(0, -radius), vec2(0, radius)});
+    mesh.updateGPU();
 }
 
 
@@ -66,9 +60,9 @@ vec2 Gondola::secondDerivative(const float t) const {
  *
  * This method initializes several properties of the gondola including its
  * position, velocity, rotation angle, and energy, and transitions its state to
- * "Started". The position is calculated using a spline and its derivative to
- * define a tangential vector and a normal vector. Progress along the spline is
- * also initialized.
+ * "Started". The position is calculated using the spline and its analytic
+ * derivative to define a tangential vector and a normal vector. Progress along
+ * the spline is also initialized.
  *
  * The state of the gondola will not change or initiate if it is not already in
  * the "Waiting" state.
@@ -78,18 +72,215 @@ void Gondola::start() {
         progressAlongSpline_ = 0.01f;
         velocity_ = 0;
 
-        const vec2 r = spline_->evaluate(progressAlongSpline_);
-        const vec2 T = normalize(derivative(progressAlongSpline_));
+        segmentHint_ = 0;
+        distanceHint_ = 0;
+        adaptiveStep_ = 0;
+        stalled_ = false;
+        distanceAlongSpline_ =
+            spline_->tToS(progressAlongSpline_, &segmentHint_);
+        const SplineSample sample =
+            spline_->evaluateWithDerivatives(progressAlongSpline_,
+                                             &segmentHint_);
+        const vec2 r = sample.position;
+        const vec2 T = normalize(sample.derivative);
         const vec2 N = vec2(-T.y, T.x);
 
         position_ = r + N * gondolaRadius_;
         rotationAngle_ = 0.0f;
+        previousPosition_ = position_;
+        previousRotationAngle_ = rotationAngle_;
         energy_ = 40.0f * r.y + 0.5f;
         state_ = Started;
     }
 }
 
 
+/**
+ * @return The height of the start of the track relative to the origin of the
+ * spline, in double, also when the start lies far from the origin.
+ */
+double Gondola::localStartHeight() const {
+    const std::vector<dvec2>& points = spline_->getWorldControlPoints();
+    return points.empty() ? 0.0 : points.front().y - spline_->getOrigin().y;
+}
+
+
+/**
+ * @brief Evaluates the spline state the physics needs at one parameter.
+ *
+ * The speed follows from the energy balance against the start of the track,
+ * it is NaN above the start height. Where the tangent vanishes the normal
+ * defaults to up and the motion is marked invalid.
+ *
+ * @param t The spline parameter.
+ * @param startHeight The height of the start of the track, see
+ * localStartHeight.
+ * @return The point, normal, speed, curvature and total normal force at t.
+ */
+Gondola::Motion Gondola::motionAt(const double t, const double startHeight) {
+    Motion motion{};
+
+    // Evaluate spline and derivatives
+    const SplineSample sample =
+        spline_->evaluateWithDerivatives(t, &segmentHint_);
+    const vec2 tangent = sample.derivative;
+    const vec2 secondTangent = sample.secondDerivative;
+    const float tangentLength = length(tangent);
+    motion.position = sample.position;
+    motion.valid = tangentLength >= EPSILON;
+
+    // Compute tangent & normal
+    motion.normal = vec2(0, 1);
+    if (motion.valid) {
+        const vec2 normalizedTangent = tangent / tangentLength;
+        motion.normal = vec2(-normalizedTangent.y, normalizedTangent.x);
+        motion.curvature =
+            (tangent.x * secondTangent.y - tangent.y * secondTangent.x) /
+            pow(tangentLength, 3.0f);
+    }
+
+    // Calculate forces, the height difference in double since the start of
+    // the track may lie far from the origin
+    const double currentHeight =
+        (motion.position + motion.normal * gondolaRadius_).y;
+    const double initialHeight =
+        startHeight + motion.normal.y * gondolaRadius_;
+    motion.speed = sqrt((2 * GRAVITY * (initialHeight - currentHeight)) / 2);
+    motion.force = motion.curvature * motion.speed * motion.speed +
+                   GRAVITY * motion.normal.y;
+    return motion;
+}
+
+
+/**
+ * @param distance An arc length along the spline.
+ * @param startHeight The height of the start of the track.
+ * @return The spline state at distance, see motionAt.
+ */
+Gondola::Motion Gondola::motionAtDistance(const double distance,
+                                          const double startHeight) {
+    return motionAt(spline_->sToT(distance, &distanceHint_), startHeight);
+}
+
+
+/**
+ * @param motion The spline state at one stage of a step.
+ * @return True if the gondola leaves the track there.
+ */
+bool Gondola::leavesTrack(const Motion& motion) {
+    return motion.valid && motion.force < 0;
+}
+
+
+/**
+ * @brief Advances the arc length by one classic Runge-Kutta step.
+ *
+ * The fall test runs on every stage, so the gondola stays where the step
+ * started if it leaves the track within the step.
+ *
+ * @param dt The time step.
+ * @param distance The arc length the step starts from.
+ * @param speed The speed at that distance.
+ * @param startHeight The height of the start of the track.
+ * @return The arc length travelled during dt.
+ */
+float Gondola::stepRK4(const float dt, const double distance,
+                       const float speed, const double startHeight) {
+    const Motion k2 =
+        motionAtDistance(distance + 0.5f * dt * speed, startHeight);
+    const Motion k3 =
+        motionAtDistance(distance + 0.5f * dt * k2.speed, startHeight);
+    const Motion k4 = motionAtDistance(distance + dt * k3.speed, startHeight);
+    if (leavesTrack(k2) || leavesTrack(k3) || leavesTrack(k4)) {
+        state_ = Fallen;
+        return 0.0f;
+    }
+    return dt / 6 * (speed + 2 * k2.speed + 2 * k3.speed + k4.speed);
+}
+
+
+/**
+ * @brief Advances the arc length with adaptive Bogacki-Shampine substeps.
+ *
+ * Each substep is a third order step with an embedded second order estimate
+ * of its error. A substep whose error exceeds the tolerance is retried
+ * shorter, and the next one grows or shrinks towards the tolerance, so the
+ * substeps are long where the speed changes slowly. They are also kept short
+ * enough for the tangent to turn by at most maxTurnPerStep, so tight curves
+ * are sampled densely. The fall test runs on every stage, and the gondola
+ * stays where the substep started if it leaves the track within it. The last
+ * stage of a substep is the first of the next one, and the substep size
+ * carries over to the next call. Only accepted substeps count towards
+ * maxAdaptiveSteps; if they run out, the rest of dt is covered by one
+ * classic Runge-Kutta step rather than dropped.
+ *
+ * @param dt The time step.
+ * @param motion The spline state at the current distance.
+ * @param startHeight The height of the start of the track.
+ * @return The arc length travelled during dt, up to the fall if the gondola
+ * left the track in between.
+ */
+float Gondola::stepAdaptive(const float dt, const Motion& motion,
+                            const double startHeight) {
+    const double start = distanceAlongSpline_;
+    double distance = start;
+    float k1 = motion.speed;
+    float curvature = motion.curvature;
+    float remaining = dt;
+    float h = adaptiveStep_ > 0 ? adaptiveStep_ : dt;
+
+    // A rejected substep shrinks until it is accepted at minAdaptiveStep at
+    // the latest, so the rejections are bounded as well
+    int accepted = 0;
+    while (remaining > 0 && accepted < maxAdaptiveSteps) {
+        float step = std::min(h, remaining);
+        const float turnRate = fabsf(curvature) * k1;
+        if (turnRate * step > maxTurnPerStep)
+            step = std::min(std::max(maxTurnPerStep / turnRate,
+                                     minAdaptiveStep),
+                            remaining);
+
+        const Motion k2 =
+            motionAtDistance(distance + 0.5f * step * k1, startHeight);
+        const Motion k3 =
+            motionAtDistance(distance + 0.75f * step * k2.speed, startHeight);
+        const double next =
+            distance + step * (2 * k1 + 3 * k2.speed + 4 * k3.speed) / 9;
+        if (!std::isfinite(next)) // climbed above the start height
+            return static_cast<float>(next - start);
+        const Motion k4 = motionAtDistance(next, startHeight);
+        const float error =
+            step * fabsf(-5.0f / 72 * k1 + 1.0f / 12 * k2.speed +
+                         1.0f / 9 * k3.speed - 1.0f / 8 * k4.speed);
+
+        // Scale the substep towards the tolerance, the error being of third
+        // order in its length
+        const float scale = std::clamp(
+            error > 0 ? 0.9f * cbrtf(tolerance_ / error) : 5.0f, 0.2f, 5.0f);
+        if (error > tolerance_ && step > minAdaptiveStep) {
+            h = std::max(step * scale, minAdaptiveStep);
+            continue;
+        }
+        h = std::max(step * scale, step < h ? h : 0.0f);
+
+        if (leavesTrack(k2) || leavesTrack(k3) || leavesTrack(k4)) {
+            state_ = Fallen;
+            break;
+        }
+        distance = next;
+        remaining -= step;
+        k1 = k4.speed;
+        curvature = k4.curvature;
+        accepted++;
+    }
+    if (remaining > 0 && state_ == Started)
+        distance += stepRK4(remaining, distance, k1, startHeight);
+
+    adaptiveStep_ = h;
+    return static_cast<float>(distance - start);
+}
+
+
 /**
  * @brief Animates the gondola's state by updating its position, rotation, and
  * progress along the spline.
@@ -97,61 +288,148 @@ void Gondola::start() {
  * This method computes the gondola's movement along a spline considering
  * physical forces such as gravity and centrifugal force. It evaluates the
  * spline geometry, calculates forces acting on the gondola, and updates its
- * velocity, position, and rotation angle. If the gondola exceeds the spline
- * bounds or experiences an unrealistic total force, its state is set to Fallen.
+ * velocity, position, and rotation angle. The gondola advances in arc length
+ * and the spline's arc length table maps the distance back to the parameter,
+ * so the step is exact regardless of the speed and the local parametrization.
+ * How far it advances is integrated by the selected GondolaIntegrator, see
+ * setIntegrator. If the gondola exceeds the spline bounds or experiences an
+ * unrealistic total force, its state is set to Fallen. So it is where it
+ * climbs above its start height, which leaves it no real speed: it stays
+ * where the step started and hasStalled tells the two apart, like the
+ * stalled cars of GondolaFleet.
+ *
+ * The state before the step is kept so that draw can interpolate between the
+ * last two physics states.
  *
  * @param dt The elapsed time since the last animation update, used for
  * calculating changes in position and velocity.
  */
 void Gondola::animate(const float dt) {
+    previousPosition_ = position_;
+    previousRotationAngle_ = rotationAngle_;
     if (state_ != Started)
         return;
 
-    constexpr float GRAVITY = 40.0f;  // Introduced constant
-    constexpr float EPSILON = 0.001f; // Small value for stability checks
-
-    // Evaluate spline and derivatives
-    const vec2 position = spline_->evaluate(progressAlongSpline_);
-    const vec2 tangent = derivative(progressAlongSpline_);
-    const vec2 secondTangent = secondDerivative(progressAlongSpline_);
-    const float tangentLength = length(tangent);
-    if (tangentLength < EPSILON)
+    const double startHeight = localStartHeight();
+    const Motion motion = motionAt(progressAlongSpline_, startHeight);
+    if (!motion.valid)
         return; // Prevent division by zero
 
-    // Compute tangent & normal
-    const vec2 normalizedTangent = tangent / tangentLength;
-    const vec2 normal = vec2(-normalizedTangent.y, normalizedTangent.x);
-
-    // Calculate forces
-    const float currentHeight = (position + normal * gondolaRadius_).y;
-    const float initialHeight =
-        (spline_->evaluate(0.0f) + normal * gondolaRadius_).y;
-
-    velocity_ = sqrt((2 * GRAVITY * (initialHeight - currentHeight)) / 2);
-
-    const float curvature =
-        (tangent.x * secondTangent.y - tangent.y * secondTangent.x) /
-        pow(tangentLength, 3.0f);
-
-    const float totalForce =
-        curvature * velocity_ * velocity_ + GRAVITY * normal.y;
-
-    if (totalForce < 0) {
+    velocity_ = motion.speed;
+    if (!std::isfinite(motion.speed)) { // climbed above the start height
+        stalled_ = true;
+        state_ = Fallen;
+        return;
+    }
+    if (motion.force < 0) {
         state_ = Fallen;
         return;
     }
 
     // Update position, rotation, and progress
-    progressAlongSpline_ += (velocity_ * dt) / tangentLength;
-    position_ = position + normal * gondolaRadius_;
-    rotationAngle_ -= (velocity_ / gondolaRadius_) * dt;
+    float advance = velocity_ * dt;
+    if (integrator_ == RK4Integrator)
+        advance = stepRK4(dt, distanceAlongSpline_, velocity_, startHeight);
+    else if (integrator_ == AdaptiveIntegrator)
+        advance = stepAdaptive(dt, motion, startHeight);
+    if (!std::isfinite(advance)) { // a stage climbed above the start height
+        stalled_ = true;
+        state_ = Fallen;
+        return;
+    }
+    distanceAlongSpline_ += advance;
+    progressAlongSpline_ =
+        spline_->sToT(distanceAlongSpline_, &distanceHint_);
+    position_ = motion.position + motion.normal * gondolaRadius_;
+    rotationAngle_ -= advance / gondolaRadius_;
+
+    // Keep the angle within a few turns, a float angle grown with the
+    // distance would turn in coarse steps on a long track
+    if (fabsf(rotationAngle_) > 2 * M_PI) {
+        const float turns = 2 * M_PI * truncf(rotationAngle_ / (2 * M_PI));
+        rotationAngle_ -= turns;
+        previousRotationAngle_ -= turns;
+    }
 
     // Check if gondola exceeds spline bounds
-    if (progressAlongSpline_ > spline_->getKnots().back())
+    if (distanceAlongSpline_ > spline_->getLength())
         state_ = Fallen;
 }
 
 
+/**
+ * @brief Selects how animate integrates the distance travelled.
+ *
+ * Euler takes one speed evaluation per step and needs short steps. RK4 takes
+ * four and stays accurate with longer ones. The adaptive integrator takes
+ * three per substep and splits each step into as many substeps as the
+ * tolerance and the curvature require, so long steps cost little on gentle
+ * track.
+ *
+ * @param integrator The integrator of the following steps.
+ * @param tolerance The arc length error allowed per adaptive substep.
+ */
+void Gondola::setIntegrator(const GondolaIntegrator integrator,
+                            const float tolerance) {
+    integrator_ = integrator;
+    tolerance_ = tolerance;
+    adaptiveStep_ = 0;
+}
+
+
+/**
+ * @return The integrator selected with setIntegrator, Euler by default.
+ */
+GondolaIntegrator Gondola::getIntegrator() const { return integrator_; }
+
+
+/**
+ * @brief Retrieves the current state of the gondola.
+ *
+ * @return Waiting before start, Started while moving and Fallen after that,
+ * also after a stall, see hasStalled.
+ */
+GondolaState Gondola::getState() const { return state_; }
+
+
+/**
+ * @return True if the gondola fell because it climbed above the height of
+ * the start of the track, see animate.
+ */
+bool Gondola::hasStalled() const { return stalled_; }
+
+
+/**
+ * @param alpha Interpolation factor between the previous (0) and the current
+ * (1) physics state, as in draw, e.g. for a camera following the gondola.
+ * @return The center of the gondola, after the last physics step by default.
+ */
+vec2 Gondola::getPosition(const float alpha) const {
+    const float a = state_ == Started ? alpha : 1.0f;
+    return mix(previousPosition_, position_, a);
+}
+
+
+/**
+ * @return The arc length travelled along the spline since the start.
+ */
+double Gondola::getDistance() const { return distanceAlongSpline_; }
+
+
+/**
+ * @brief Moves the gondola along with a rebased spline, see Spline::rebase.
+ *
+ * Only the positions move: the progress and the distance along the spline
+ * are the same in both frames.
+ *
+ * @param offset The offset subtracted from the spline coordinates.
+ */
+void Gondola::rebase(const vec2 offset) {
+    position_ -= offset;
+    previousPosition_ -= offset;
+}
+
+
 /**
  * @brief Draws the gondola using the specified shader program and
  * transformation matrix.
@@ -160,15 +438,59 @@ void Gondola::animate(const float dt) {
  * state. It applies the transformation matrix to the gondola's position and
  * rotation, sets the uniform values for the shader, and draws the gondola's
  * components (body and spokes). The body is drawn in two passes: once as a
- * filled shape and once as a wireframe*/
-void Gondola::draw(GPUProgram* shader, const mat4& MVP) {
+ * filled shape and once as a wireframe.
+ *
+ * @param shader The GPU program used for rendering.
+ * @param MVP The model-view-projection matrix of the scene.
+ * @param alpha Interpolation factor between the previous (0) and the current
+ * (1) physics state, see glApp::interpolationAlpha. It is ignored once the
+ * gondola stopped, since no further physics steps will follow.
+ */
+void Gondola::draw(GPUProgram* shader, const mat4& MVP, const float alpha) {
+    if (state_ == Waiting)
+        return;
+
+    const float a = state_ == Started ? alpha : 1.0f;
+    const vec2 position = mix(previousPosition_, position_, a);
+    const float rotationAngle = mix(previousRotationAngle_, rotationAngle_, a);
+    const mat4 M = translate(vec3(position.x, position.y, 0)) *
+                   rotate(rotationAngle, vec3(0, 0, 1));
+    const UniformHandle color = shader->uniform("color");
+    shader->setUniform(MVP * M, shader->uniform("MVP"));
+    mesh_.Draw(shader, GL_TRIANGLE_FAN, vec3(0.2f, 0.4f, 1.0f), color,
+               bodyFirst, bodyCount);
+    mesh_.Draw(shader, GL_LINE_LOOP, vec3(1, 1, 1), color, rimFirst,
+               rimCount);
+    mesh_.Draw(shader, GL_LINES, vec3(1, 1, 1), color, spokesFirst,
+               spokesCount);
+}
+
+
+/**
+ * @brief Queues the gondola in a BatchRenderer.
+ *
+ * The same picture as draw: the filled body on the body layer and the rim
+ * and spokes on the outline layer, transformed on the CPU with the
+ * interpolated model matrix. Nothing is queued in the Waiting state.
+ *
+ * @param batch The renderer of the frame.
+ * @param alpha Interpolation factor between the previous (0) and the current
+ * (1) physics state, see glApp::interpolationAlpha.
+ */
+void Gondola::submit(BatchRenderer& batch, const float alpha) const {
     if (state_ == Waiting)
         return;
 
-    const mat4 M = translate(vec3(position_.x, position_.y, 0)) *
-                   rotate(rotationAngle_, vec3(0, 0, 1));
-    shader->setUniform(MVP * M, "MVP");
-    body_.Draw(shader, GL_TRIANGLE_FAN, vec3(0.2f, 0.4f, 1.0f));
-    body_.Draw(shader, GL_LINE_LOOP, vec3(1, 1, 1));
-    spokes_.Draw(shader, GL_LINES, vec3(1, 1, 1));
+    const float a = state_ == Started ? alpha : 1.0f;
+    const vec2 position = mix(previousPosition_, position_, a);
+    const float rotationAngle = mix(previousRotationAngle_, rotationAngle_, a);
+    const mat4 M = translate(vec3(position.x, position.y, 0)) *
+                   rotate(rotationAngle, vec3(0, 0, 1));
+    const vec2* vtx = mesh_.Vtx().data();
+    batch.submit(BodyLayer, GL_TRIANGLE_FAN, vtx + bodyFirst, bodyCount,
+                 vec3(0.2f, 0.4f, 1.0f), 1.0f, M);
+    batch.submit(OutlineLayer, GL_LINE_LOOP, vtx + rimFirst, rimCount,
+                 vec3(1, 1, 1), 1.0f, M);
+    batch.submit(OutlineLayer, GL_LINES, vtx + spokesFirst, spokesCount,
+                 vec3(1, 1, 1), 1.0f, M);
 }
@@ -6,34 +6,101 @@
 
 enum GondolaState { Waiting, Started, Fallen };
 
+// How animate advances the arc length: one explicit Euler step, one classic
+// Runge-Kutta step, or Bogacki-Shampine substeps sized by an error tolerance
+// and the curvature
+enum GondolaIntegrator { EulerIntegrator, RK4Integrator, AdaptiveIntegrator };
+
 
 class Gondola {
 
     Spline* spline_;
-    float progressAlongSpline_;
+    double progressAlongSpline_;
+    double distanceAlongSpline_;
     float velocity_;
     float energy_;
+    int segmentHint_;
+    int distanceHint_;
 
     vec2 position_;
     float rotationAngle_;
+    vec2 previousPosition_;
+    float previousRotationAngle_;
     const float gondolaRadius_ = 1.0f;
 
     GondolaState state_;
-    Geometry<vec2> body_;
-    Geometry<vec2> spokes_;
+    bool stalled_ = false; // fell for lack of energy, see hasStalled
+    Geometry<vec2> mesh_;
+
+    GondolaIntegrator integrator_ = EulerIntegrator;
+    float tolerance_ = 1e-3f; // arc length error per adaptive substep
+    float adaptiveStep_ = 0;  // last accepted substep, 0 before the first
+
+    // Spline state at one arc length, see motionAt
+    struct Motion {
+        vec2 position;
+        vec2 normal;
+        float speed;
+        float curvature;
+        float force; // negative where the gondola leaves the track
+        bool valid;  // false where the tangent vanishes
+    };
+
+    double localStartHeight() const;
+
+    Motion motionAt(double t, double startHeight);
+
+    Motion motionAtDistance(double distance, double startHeight);
+
+    static bool leavesTrack(const Motion& motion);
+
+    float stepRK4(float dt, double distance, float speed, double startHeight);
+
+    float stepAdaptive(float dt, const Motion& motion, double startHeight);
 
   public:
-    explicit Gondola(Spline* spline);
+    static constexpr float GRAVITY = 40.0f;  // Introduced constant
+    static constexpr float EPSILON = 0.001f; // Small value for stability checks
+
+    // Limits of the adaptive substeps: the largest turn of the tangent per
+    // substep in radians, the shortest substep in seconds and the most
+    // accepted substeps per animate call
+    static constexpr float maxTurnPerStep = 0.1f;
+    static constexpr float minAdaptiveStep = 1e-5f;
+    static constexpr int maxAdaptiveSteps = 1000;
+
+    // Vertex ranges of the mesh built by buildMesh: the body as a triangle
+    // fan, its rim as a line loop and the spokes as lines
+    static constexpr int meshSegments = 32;
+    static constexpr int bodyFirst = 0, bodyCount = meshSegments + 2;
+    static constexpr int rimFirst = 1, rimCount = meshSegments + 1;
+    static constexpr int spokesFirst = bodyCount, spokesCount = 4;
 
-    vec2 derivative(float t) const;
+    explicit Gondola(Spline* spline);
 
-    vec2 secondDerivative(float t) const;
+    static void buildMesh(Geometry<vec2>& mesh, float radius);
 
     void start();
 
     void animate(float dt);
 
-    void draw(GPUProgram* shader, const mat4& MVP);
+    void setIntegrator(GondolaIntegrator integrator, float tolerance = 1e-3f);
+
+    GondolaIntegrator getIntegrator() const;
+
+    GondolaState getState() const;
+
+    bool hasStalled() const;
+
+    vec2 getPosition(float alpha = 1.0f) const;
+
+    double getDistance() const;
+
+    void rebase(vec2 offset);
+
+    void draw(GPUProgram* shader, const mat4& MVP, float alpha = 1.0f);
+
+    void submit(BatchRenderer& batch, float alpha = 1.0f) const;
 };
 
 
@@ -0,0 +1,530 @@
+#include "GondolaFleet.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <thread>
+
+#ifdef GONDOLA_BENCH_GL
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#endif
+
+
+// Work of one timed run, filled in by the benchmark body
+struct BenchState {
+    size_t iterations = 0;
+    double items = 0; // items processed by the whole run
+    double bytes = 0; // bytes processed by the whole run
+};
+
+using BenchBody = std::function<void(BenchState&)>;
+
+// A benchmark builds its fixture once, untimed, and returns the timed body
+struct Benchmark {
+    std::string name;
+    std::function<BenchBody()> setup;
+};
+
+// Measurement of one benchmark, per iteration
+struct BenchResult {
+    std::string name;
+    size_t iterations;
+    double realTime; // ns
+    double cpuTime;  // ns, of the whole process
+    double itemsPerSecond;
+    double bytesPerSecond;
+};
+
+
+// Keeps the results of the timed loops alive
+static volatile float sink;
+
+static void consume(const vec2 v) { sink = v.x + v.y; }
+
+static void consume(const float x) { sink = x; }
+
+
+/**
+ * @brief Generates a track of n control points.
+ *
+ * The track descends steadily with small waves and a little noise. The
+ * first point is raised so that a gondola starting there has the energy to
+ * ride over the noise, it runs for a few seconds until it is fast enough to
+ * fly off a crest. The same n always gives the same track.
+ *
+ * @param n The number of control points.
+ * @return The control points.
+ */
+static std::vector<vec2> syntheticTrack(const size_t n) {
+    std::mt19937 rng(static_cast<unsigned>(n));
+    std::uniform_real_distribution<float> noise(-0.25f, 0.25f);
+    std::vector<vec2> points(n);
+    for (size_t i = 0; i < n; i++) {
+        const float x = static_cast<float>(i);
+        points[i] = vec2(4.0f * x, -x + 3.0f * sinf(0.3f * x) + noise(rng));
+    }
+    if (n > 0)
+        points[0].y += 2.0f;
+    return points;
+}
+
+
+/**
+ * @brief Creates a spline holding a synthetic track, the fixture shared by
+ * the spline and gondola benchmarks.
+ *
+ * @param n The number of control points, see syntheticTrack.
+ * @param renderable False for a spline without GL resources, see Spline.
+ * @return The spline, shared with the timed body.
+ */
+static std::shared_ptr<Spline> syntheticSpline(const size_t n,
+                                               const bool renderable = false) {
+    const std::vector<vec2> track = syntheticTrack(n);
+    const std::vector<dvec2> points(track.begin(), track.end());
+    std::vector<float> knots(n);
+    std::iota(knots.begin(), knots.end(), 0.0f);
+    auto spline = std::make_shared<Spline>(renderable);
+    spline->assign(points.data(), knots.data(), n);
+    return spline;
+}
+
+
+/**
+ * @brief Restarts every car of a fleet, spread over the first half of the
+ * track.
+ *
+ * @param fleet The fleet, every car of which is reset to Waiting first.
+ * @param length The arc length of the track.
+ */
+static void restartFleet(GondolaFleet& fleet, const float length) {
+    const size_t count = fleet.size();
+    fleet.resize(0);
+    fleet.resize(count);
+    for (size_t i = 0; i < count; i++)
+        fleet.startAt(i, 0.5f * length * static_cast<float>(i) /
+                             static_cast<float>(count));
+}
+
+
+/**
+ * @brief Times a benchmark.
+ *
+ * The body is run with a growing number of iterations until one run takes
+ * at least minTime, and that run is reported, as Google Benchmark does.
+ *
+ * @param benchmark The benchmark.
+ * @param minTime The minimum duration of the reported run in seconds.
+ * @return The times per iteration.
+ */
+static BenchResult run(const Benchmark& benchmark, const double minTime) {
+    const BenchBody body = benchmark.setup();
+    BenchState state;
+    size_t iterations = 1;
+    double real = 0, cpu = 0;
+    for (;;) {
+        state = BenchState{iterations};
+        const std::clock_t cpuBegin = std::clock();
+        const auto begin = std::chrono::steady_clock::now();
+        body(state);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+        real = elapsed.count();
+        cpu = static_cast<double>(std::clock() - cpuBegin) / CLOCKS_PER_SEC;
+        if (real >= minTime || iterations >= 1000000000)
+            break;
+        // Aim 40% past minTime, growing at most tenfold per attempt
+        const double scale = real > 0.1 * minTime ? 1.4 * minTime / real : 10;
+        iterations = std::max(iterations + 1,
+                              static_cast<size_t>(iterations * scale));
+    }
+    const double n = static_cast<double>(iterations);
+    return {benchmark.name,
+            iterations,
+            real * 1e9 / n,
+            cpu * 1e9 / n,
+            state.items / real,
+            state.bytes / real};
+}
+
+
+/**
+ * @brief Quotes a string for JSON.
+ *
+ * Quotes and backslashes are escaped with a backslash and control
+ * characters are written as unicode escapes, so paths and names of any
+ * content give valid JSON.
+ *
+ * @param text The string.
+ * @return The JSON string literal, with the quotes.
+ */
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + '"';
+}
+
+
+/**
+ * @brief Writes the results in the JSON format of Google Benchmark, so the
+ * existing comparison tools and dashboards read them.
+ *
+ * @param out The output stream.
+ * @param executable The name the benchmark was run as.
+ * @param results The results.
+ */
+static void writeJson(FILE* out, const char* executable,
+                      const std::vector<BenchResult>& results) {
+    char date[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z",
+                  std::localtime(&now));
+#ifdef NDEBUG
+    const char* buildType = "release";
+#else
+    const char* buildType = "debug";
+#endif
+
+    fprintf(out, "{\n  \"context\": {\n");
+    fprintf(out, "    \"date\": \"%s\",\n", date);
+    fprintf(out, "    \"executable\": %s,\n",
+            jsonString(executable).c_str());
+    fprintf(out, "    \"num_cpus\": %u,\n",
+            std::thread::hardware_concurrency());
+    fprintf(out, "    \"library_build_type\": \"%s\"\n", buildType);
+    fprintf(out, "  },\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(out, "%s\n    {\n", i ? "," : "");
+        const std::string name = jsonString(r.name);
+        fprintf(out, "      \"name\": %s,\n", name.c_str());
+        fprintf(out, "      \"run_name\": %s,\n", name.c_str());
+        fprintf(out, "      \"run_type\": \"iteration\",\n");
+        fprintf(out, "      \"repetitions\": 1,\n");
+        fprintf(out, "      \"repetition_index\": 0,\n");
+        fprintf(out, "      \"threads\": 1,\n");
+        fprintf(out, "      \"iterations\": %zu,\n", r.iterations);
+        fprintf(out, "      \"real_time\": %.6g,\n", r.realTime);
+        fprintf(out, "      \"cpu_time\": %.6g,\n", r.cpuTime);
+        fprintf(out, "      \"time_unit\": \"ns\"");
+        if (r.itemsPerSecond > 0)
+            fprintf(out, ",\n      \"items_per_second\": %.6g",
+                    r.itemsPerSecond);
+        if (r.bytesPerSecond > 0)
+            fprintf(out, ",\n      \"bytes_per_second\": %.6g",
+                    r.bytesPerSecond);
+        fprintf(out, "\n    }");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+
+/**
+ * @brief Registers the benchmarks that need no GL context.
+ *
+ * @param benchmarks Receives the benchmarks.
+ * @param sizes The track sizes in control points.
+ * @param jobs The job system of the parallel fleet benchmarks.
+ */
+static void addHeadless(std::vector<Benchmark>& benchmarks,
+                        const std::vector<size_t>& sizes, JobSystem& jobs) {
+    benchmarks.push_back({"Hermite", [] {
+        return [](BenchState& state) {
+            const vec2 p0(0, 0), p1(1, 2), v0(1, 0), v1(0, 1);
+            for (size_t i = 0; i < state.iterations; i++)
+                consume(Hermite(p0, v0, 0, p1, v1, 1, (i & 1023) / 1024.0f));
+            state.items = state.iterations;
+        };
+    }});
+
+    for (const size_t n : sizes) {
+        const std::string size = "/" + std::to_string(n);
+
+        // Uniformly random parameters: a binary search per query
+        benchmarks.push_back({"SplineEvaluateRandom" + size, [n] {
+            auto spline = syntheticSpline(n);
+            auto ts = std::make_shared<std::vector<float>>(4096);
+            std::mt19937 rng(1);
+            std::uniform_real_distribution<float> t(0, n - 1.0f);
+            for (float& x : *ts)
+                x = t(rng);
+            return [spline, ts](BenchState& state) {
+                for (size_t i = 0; i < state.iterations; i++)
+                    consume(spline->evaluate((*ts)[i & 4095]));
+                state.items = state.iterations;
+            };
+        }});
+
+        // Increasing parameters with a segment hint, as the physics does
+        benchmarks.push_back({"SplineEvaluateMonotonic" + size, [n] {
+            auto spline = syntheticSpline(n);
+            return [spline, n](BenchState& state) {
+                const float step = (n - 1.0f) / 65536.0f;
+                int hint = 0;
+                for (size_t i = 0; i < state.iterations; i++)
+                    consume(spline->evaluate((i & 65535) * step, &hint));
+                state.items = state.iterations;
+            };
+        }});
+
+        benchmarks.push_back({"SplineEvaluateBatch" + size, [n] {
+            auto spline = syntheticSpline(n);
+            auto ts = std::make_shared<std::vector<double>>(4096);
+            for (size_t i = 0; i < ts->size(); i++)
+                (*ts)[i] = (n - 1.0) * i / ts->size();
+            auto out = std::make_shared<std::vector<vec2>>(ts->size());
+            return [spline, ts, out](BenchState& state) {
+                for (size_t i = 0; i < state.iterations; i++) {
+                    spline->evaluateBatch(ts->data(), out->data(), ts->size());
+                    consume(out->back());
+                }
+                state.items = double(state.iterations) * ts->size();
+            };
+        }});
+
+        // Coefficients, bounds and arc length table of the whole track
+        benchmarks.push_back({"SplineAssign" + size, [n] {
+            const std::vector<vec2> track = syntheticTrack(n);
+            auto points = std::make_shared<std::vector<dvec2>>(track.begin(),
+                                                               track.end());
+            auto knots = std::make_shared<std::vector<float>>(n);
+            std::iota(knots->begin(), knots->end(), 0.0f);
+            return [points, knots, n](BenchState& state) {
+                Spline spline(false);
+                for (size_t i = 0; i < state.iterations; i++) {
+                    spline.assign(points->data(), knots->data(), n);
+                    consume(spline.getLength());
+                }
+                state.items = double(state.iterations) * n;
+            };
+        }});
+    }
+
+    const size_t trackSize = std::min<size_t>(sizes.back(), 100000);
+    const std::string track = "/" + std::to_string(trackSize);
+
+    // Each integrator runs at a step of similar accuracy, and the items are
+    // hundredths of a second of simulated time, so they compare per second
+    struct Integration {
+        const char* name;
+        GondolaIntegrator integrator;
+        float dt;
+    };
+    const Integration integrations[] = {
+        {"GondolaAnimate", EulerIntegrator, 0.01f},
+        {"GondolaAnimateRK4", RK4Integrator, 0.05f},
+        {"GondolaAnimateAdaptive", AdaptiveIntegrator, 0.1f}};
+    for (const auto& [name, integrator, dt] : integrations) {
+        benchmarks.push_back({name + track, [trackSize, integrator, dt] {
+            auto spline = syntheticSpline(trackSize);
+            return [spline, integrator, dt](BenchState& state) {
+                // A fallen gondola cannot be restarted, a new one is placed
+                std::unique_ptr<Gondola> gondola;
+                for (size_t i = 0; i < state.iterations; i++) {
+                    if (!gondola || gondola->getState() != Started) {
+                        gondola = std::make_unique<Gondola>(spline.get());
+                        gondola->setIntegrator(integrator);
+                        gondola->start();
+                    }
+                    gondola->animate(dt);
+                }
+                consume(gondola->getPosition());
+                state.items = double(state.iterations) * dt * 100;
+            };
+        }});
+    }
+
+    for (const size_t cars : {1000, 100000}) {
+        for (JobSystem* pool : {static_cast<JobSystem*>(nullptr), &jobs}) {
+            const std::string name = pool ? "FleetAnimateParallel/"
+                                          : "FleetAnimate/";
+            benchmarks.push_back({name + std::to_string(cars),
+                                  [trackSize, cars, pool] {
+                auto spline = syntheticSpline(trackSize);
+                auto fleet = std::make_shared<GondolaFleet>(spline.get());
+                fleet->resize(cars);
+                restartFleet(*fleet, spline->getLength());
+                return [spline, fleet, cars, pool](BenchState& state) {
+                    for (size_t i = 0; i < state.iterations; i++) {
+                        if (fleet->startedCount() == 0)
+                            restartFleet(*fleet, spline->getLength());
+                        fleet->animateAll(0.01f, pool);
+                    }
+                    consume(fleet->getPosition(0));
+                    state.items = double(state.iterations) * cars;
+                };
+            }});
+        }
+    }
+}
+
+
+#ifdef GONDOLA_BENCH_GL
+/**
+ * @brief Registers the benchmarks that upload to the GPU.
+ *
+ * Every iteration ends with glFinish, so the transfer is part of the time.
+ *
+ * @param benchmarks Receives the benchmarks.
+ * @param sizes The track sizes in control points.
+ */
+static void addUpload(std::vector<Benchmark>& benchmarks,
+                      const std::vector<size_t>& sizes) {
+    for (const size_t n : sizes) {
+        const std::string size = "/" + std::to_string(n);
+
+        // Adaptive tessellation of the whole track and its upload
+        benchmarks.push_back({"SplineUpdate" + size, [n] {
+            auto spline = syntheticSpline(n, true);
+            return [spline, n](BenchState& state) {
+                for (size_t i = 0; i < state.iterations; i++) {
+                    spline->update();
+                    glFinish();
+                }
+                state.items = double(state.iterations) * n;
+            };
+        }});
+
+        benchmarks.push_back({"GeometryUpload" + size, [n] {
+            auto geometry = std::make_shared<Geometry<vec2>>();
+            geometry->Vtx() = syntheticTrack(n);
+            geometry->updateGPU();
+            return [geometry, n](BenchState& state) {
+                for (size_t i = 0; i < state.iterations; i++) {
+                    geometry->updateGPU();
+                    glFinish();
+                }
+                state.bytes = double(state.iterations) * n * sizeof(vec2);
+            };
+        }});
+    }
+}
+
+
+/**
+ * @brief Creates an invisible window whose GL context the upload benchmarks
+ * use.
+ *
+ * @return The window, or nullptr if no context is available.
+ */
+static GLFWwindow* createContext() {
+    if (!glfwInit())
+        return nullptr;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "gondola_bench", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    gladLoadGL();
+    return window;
+}
+#endif
+
+
+/**
+ * @brief Prints the command line usage.
+ */
+static void printUsage() {
+    printf("Usage: bench [--filter text] [--min-time seconds] "
+           "[--max-points count]\n             [--out file]\n"
+           "Times the spline and gondola hot paths on synthetic tracks of 10 "
+           "to 1M points\nand writes the results as Google Benchmark JSON, to "
+           "stdout or the --out file.\n");
+}
+
+
+/**
+ * @brief Runs the benchmarks whose name contains the filter and reports
+ * them: a table on stderr and JSON on stdout or in a file.
+ *
+ * @return 0 on success, 1 if the output cannot be written, 2 on invalid
+ * arguments.
+ */
+int main(const int argc, char* argv[]) {
+    std::string filter;
+    double minTime = 0.5;
+    size_t maxPoints = 1000000;
+    const char* outputPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--filter") == 0 && hasValue)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--min-time") == 0 && hasValue)
+            minTime = strtod(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--max-points") == 0 && hasValue)
+            maxPoints = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--out") == 0 && hasValue)
+            outputPath = argv[++i];
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (minTime <= 0 || maxPoints < 10) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<size_t> sizes;
+    for (size_t n = 10; n <= maxPoints; n *= 100)
+        sizes.push_back(n);
+    if (sizes.back() < maxPoints && maxPoints <= 1000000)
+        sizes.push_back(maxPoints);
+
+    JobSystem jobs;
+    std::vector<Benchmark> benchmarks;
+    addHeadless(benchmarks, sizes, jobs);
+#ifdef GONDOLA_BENCH_GL
+    GLFWwindow* window = createContext();
+    if (window)
+        addUpload(benchmarks, sizes);
+    else
+        fprintf(stderr, "No GL context, skipping the upload benchmarks\n");
+#endif
+
+    std::vector<BenchResult> results;
+    for (const Benchmark& benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == std::string::npos)
+            continue;
+        results.push_back(run(benchmark, minTime));
+        const BenchResult& r = results.back();
+        fprintf(stderr, "%-32s %14.1f ns %14.1f ns %12zu\n", r.name.c_str(),
+                r.realTime, r.cpuTime, r.iterations);
+    }
+
+#ifdef GONDOLA_BENCH_GL
+    if (window)
+        glfwTerminate();
+#endif
+
+    FILE* out = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Cannot write %s\n", outputPath);
+        return 1;
+    }
+    writeJson(out, argv[0], results);
+    if (outputPath)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,786 @@
+#include "GondolaFleet.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+
+// Default color of the car bodies, the one of Gondola
+static const vec3 bodyColor = vec3(0.2f, 0.4f, 1.0f);
+
+
+/**
+ * @brief Constructs an empty fleet running on the given spline.
+ *
+ * The fleet owns a single mesh shared by all of its cars, built only for a
+ * renderable spline.
+ *
+ * @param spline Pointer to the Spline the cars move along.
+ * @param radius The radius of every car.
+ */
+GondolaFleet::GondolaFleet(const Spline* spline, const float radius)
+    : spline_(spline), radius_(radius) {
+    if (spline_->isRenderable())
+        Gondola::buildMesh(mesh_, radius_);
+}
+
+
+/**
+ * @brief Releases the VAO of the instanced mesh and the buffers of the GPU
+ * physics.
+ */
+GondolaFleet::~GondolaFleet() {
+    if (instancedVao_ != 0) {
+        VertexArena<vec2>::get().detach(instancedVao_);
+        glDeleteVertexArrays(1, &instancedVao_);
+    }
+    if (readbackBuffer_ != 0) {
+        for (const GLsync fence : readbackFences_)
+            if (fence != nullptr)
+                glDeleteSync(fence);
+        glUnmapNamedBuffer(readbackBuffer_);
+        const unsigned int buffers[] = {carBuffer_, segmentBuffer_,
+                                        arcLengthBuffer_, counterBuffer_,
+                                        readbackBuffer_};
+        glDeleteBuffers(5, buffers);
+    }
+}
+
+
+/**
+ * @brief Sets the number of cars in the fleet.
+ *
+ * New cars are in the Waiting state. Shrinking the fleet drops the cars with
+ * the highest indices.
+ *
+ * @param count The new number of cars.
+ */
+void GondolaFleet::resize(const size_t count) {
+    if (!cpuCurrent_)
+        downloadCars();
+    gpuCurrent_ = false;
+    progressAlongSpline_.resize(count, 0.0f);
+    distanceAlongSpline_.resize(count, 0.0f);
+    velocity_.resize(count, 0.0f);
+    energy_.resize(count, 0.0f);
+    positionX_.resize(count, 0.0f);
+    positionY_.resize(count, 0.0f);
+    rotationAngle_.resize(count, 0.0f);
+    previousPositionX_.resize(count, 0.0f);
+    previousPositionY_.resize(count, 0.0f);
+    previousRotationAngle_.resize(count, 0.0f);
+    state_.resize(count, Waiting);
+    color_.resize(count, packColor(bodyColor));
+    segmentHint_.resize(count, 0);
+    distanceHint_.resize(count, 0);
+
+    sampleX_.resize(count);
+    sampleY_.resize(count);
+    tangentX_.resize(count);
+    tangentY_.resize(count);
+    secondX_.resize(count);
+    secondY_.resize(count);
+    moved_.resize(count);
+
+    startedCount_ = 0;
+    for (const uint8_t state : state_)
+        startedCount_ += state == Started;
+}
+
+
+/**
+ * @return The number of cars in the fleet.
+ */
+size_t GondolaFleet::size() const { return state_.size(); }
+
+
+/**
+ * @brief Starts car i from the beginning of the spline, like Gondola::start.
+ *
+ * @param i The index of the car.
+ */
+void GondolaFleet::start(const size_t i) {
+    startAt(i, spline_->tToS(0.01f));
+}
+
+
+/**
+ * @brief Starts car i at the given arc length along the spline.
+ *
+ * The car is placed on the normal side of the track and starts moving with
+ * the speed it would have gained rolling there from the start of the spline.
+ * A car placed higher than the start has no such speed: it starts with the
+ * small push of Gondola::start instead. The energy of each car is kept, so
+ * its speed only depends on its own start. Cars that are not Waiting are
+ * left unchanged.
+ *
+ * @param i The index of the car.
+ * @param distance The arc length where the car is placed.
+ */
+void GondolaFleet::startAt(const size_t i, const double distance) {
+    if (!cpuCurrent_)
+        downloadCars();
+    if (state_[i] != Waiting)
+        return;
+    gpuCurrent_ = false;
+
+    segmentHint_[i] = 0;
+    distanceHint_[i] = 0;
+    distanceAlongSpline_[i] = distance;
+    progressAlongSpline_[i] = spline_->sToT(distance, &distanceHint_[i]);
+    velocity_[i] = 0.0f;
+
+    const SplineSample sample = spline_->evaluateWithDerivatives(
+        progressAlongSpline_[i], &segmentHint_[i]);
+    const vec2 T = normalize(sample.derivative);
+    const vec2 N = vec2(-T.y, T.x);
+    const vec2 position = sample.position + N * radius_;
+
+    positionX_[i] = previousPositionX_[i] = position.x;
+    positionY_[i] = previousPositionY_[i] = position.y;
+    rotationAngle_[i] = previousRotationAngle_[i] = 0.0f;
+    const float startHeight = spline_->evaluate(0.0f).y;
+    const float restHeight = std::max(startHeight, sample.position.y);
+    energy_[i] = Gondola::GRAVITY * restHeight +
+                 (restHeight > startHeight ? 0.5f : 0.0f);
+    state_[i] = Started;
+    startedCount_++;
+}
+
+
+/**
+ * @brief Sets the body color of car i.
+ *
+ * @param i The index of the car.
+ * @param color The new color.
+ */
+void GondolaFleet::setColor(const size_t i, const vec3 color) {
+    if (!cpuCurrent_)
+        downloadCars();
+    color_[i] = packColor(color);
+    gpuCurrent_ = false;
+}
+
+
+/**
+ * @brief Advances every started car by dt.
+ *
+ * The physics is that of Gondola::animate. With a JobSystem the cars are split
+ * into chunks of a multiple of chunkGrain cars that are advanced in parallel,
+ * see animateRange; the number of started and fallen cars is summed up
+ * atomically across the chunks. In GPU physics mode the step is dispatched
+ * on the GPU instead, see animateGPU.
+ *
+ * @param dt The elapsed time since the last animation update.
+ * @param jobs Optional JobSystem running the chunks, nullptr to run on the
+ * calling thread.
+ */
+void GondolaFleet::animateAll(const float dt, JobSystem* jobs) {
+    if (gpuPhysics_ != nullptr) {
+        animateGPU(dt);
+        return;
+    }
+    const size_t n = size();
+    fallenCount_ = 0;
+    if (startedCount_ == 0) {
+        previousPositionX_ = positionX_;
+        previousPositionY_ = positionY_;
+        previousRotationAngle_ = rotationAngle_;
+        return;
+    }
+
+    StepTotals totals;
+    if (jobs == nullptr) {
+        animateRange(0, n, dt, totals);
+    } else {
+        // A few chunks per thread so that stealing can even out the load
+        const size_t chunks = 4 * (jobs->threadCount() + 1);
+        const size_t grain =
+            std::max<size_t>(1, (n + chunks * chunkGrain - 1) /
+                                    (chunks * chunkGrain)) *
+            chunkGrain;
+        jobs->parallelFor(n, grain, [&](const size_t begin, const size_t end) {
+            animateRange(begin, end, dt, totals);
+        });
+    }
+    startedCount_ = totals.started;
+    fallenCount_ = totals.fallen;
+}
+
+
+/**
+ * @brief Moves every car along with a rebased spline, see Spline::rebase.
+ *
+ * Only the positions and the energies, which hold the height of the start,
+ * move; the progress and the distance along the spline are the same in both
+ * frames. In GPU physics mode the cars are downloaded first and uploaded
+ * again on the next step.
+ *
+ * @param offset The offset subtracted from the spline coordinates.
+ */
+void GondolaFleet::rebase(const vec2 offset) {
+    if (!cpuCurrent_)
+        downloadCars();
+    gpuCurrent_ = false;
+    for (size_t i = 0; i < size(); i++) {
+        positionX_[i] -= offset.x;
+        positionY_[i] -= offset.y;
+        previousPositionX_[i] -= offset.x;
+        previousPositionY_[i] -= offset.y;
+        energy_[i] -= Gondola::GRAVITY * offset.y;
+    }
+}
+
+
+/**
+ * @brief Advances the started cars in [begin, end) by dt.
+ *
+ * The step runs in three passes: the spline is sampled for every started car,
+ * the forces, velocities and fall tests are evaluated without branches over
+ * the SoA arrays, and the distances of the cars that moved are mapped back to
+ * spline parameters. Only the cars of the range are touched, so disjoint
+ * ranges may run concurrently.
+ *
+ * The speed of a car follows from its energy, see startAt. A car that climbs
+ * to where its energy runs out cannot go on, and would otherwise take the
+ * square root of a negative number: it stops there and counts as Fallen, as
+ * does a car whose spline sample is not finite.
+ *
+ * @param begin The first car of the range.
+ * @param end One past the last car of the range.
+ * @param dt The elapsed time since the last animation update.
+ * @param totals Receives the number of started and of newly fallen cars.
+ */
+void GondolaFleet::animateRange(const size_t begin, const size_t end,
+                                const float dt, StepTotals& totals) {
+    std::copy(positionX_.begin() + begin, positionX_.begin() + end,
+              previousPositionX_.begin() + begin);
+    std::copy(positionY_.begin() + begin, positionY_.begin() + end,
+              previousPositionY_.begin() + begin);
+    std::copy(rotationAngle_.begin() + begin, rotationAngle_.begin() + end,
+              previousRotationAngle_.begin() + begin);
+
+    // Pass 1: sample the spline
+    for (size_t i = begin; i < end; i++) {
+        if (state_[i] != Started) {
+            tangentX_[i] = tangentY_[i] = 0.0f;
+            continue;
+        }
+        const SplineSample sample = spline_->evaluateWithDerivatives(
+            progressAlongSpline_[i], &segmentHint_[i]);
+        sampleX_[i] = sample.position.x;
+        sampleY_[i] = sample.position.y;
+        tangentX_[i] = sample.derivative.x;
+        tangentY_[i] = sample.derivative.y;
+        secondX_[i] = sample.secondDerivative.x;
+        secondY_[i] = sample.secondDerivative.y;
+    }
+
+    // Pass 2: forces and motion, branch-free so that it vectorizes. Cars that
+    // are not started have a zero tangent and are therefore left unchanged.
+    constexpr float GRAVITY = Gondola::GRAVITY;
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+    const float radius = radius_;
+    uint8_t* const state = state_.data();
+    float* const velocity = velocity_.data();
+    const float* const energy = energy_.data();
+    double* const distance = distanceAlongSpline_.data();
+    float* const positionX = positionX_.data();
+    float* const positionY = positionY_.data();
+    float* const rotation = rotationAngle_.data();
+    const float* const sx = sampleX_.data();
+    const float* const sy = sampleY_.data();
+    const float* const tx = tangentX_.data();
+    const float* const ty = tangentY_.data();
+    const float* const ax = secondX_.data();
+    const float* const ay = secondY_.data();
+    uint8_t* const moved = moved_.data();
+    size_t fallen = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        const float tangentLength = sqrtf(tx[i] * tx[i] + ty[i] * ty[i]);
+        const bool valid = tangentLength >= Gondola::EPSILON;
+        // A broken state would otherwise keep the car started forever
+        const bool broken = !(tangentLength < infinity);
+        const float inverseLength = 1.0f / fmaxf(tangentLength, 1e-30f);
+        const float normalX = -ty[i] * inverseLength;
+        const float normalY = tx[i] * inverseLength;
+
+        // A negative or NaN kinetic energy stalls the car
+        const float kinetic = energy[i] - GRAVITY * sy[i];
+        const bool stall = !(kinetic > 0.0f);
+        const float v = sqrtf(fmaxf(kinetic, 0.0f));
+
+        const float curvature = (tx[i] * ay[i] - ty[i] * ax[i]) *
+                                inverseLength * inverseLength * inverseLength;
+        const float totalForce = curvature * v * v + GRAVITY * normalY;
+
+        const bool fall = broken || (valid && (stall || totalForce < 0));
+        const bool move = valid && !fall;
+        velocity[i] = valid ? v : velocity[i];
+        distance[i] += move ? v * dt : 0.0f;
+        positionX[i] = move ? sx[i] + normalX * radius : positionX[i];
+        positionY[i] = move ? sy[i] + normalY * radius : positionY[i];
+        rotation[i] -= move ? (v / radius) * dt : 0.0f;
+        state[i] = fall ? static_cast<uint8_t>(Fallen) : state[i];
+        moved[i] = move;
+        fallen += fall;
+    }
+
+    // Pass 3: map the new distances to spline parameters
+    const double splineLength = spline_->getLength();
+    size_t started = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (moved[i]) {
+            progressAlongSpline_[i] =
+                spline_->sToT(distance[i], &distanceHint_[i]);
+            if (distance[i] > splineLength) {
+                state[i] = Fallen;
+                fallen++;
+            }
+        }
+        started += state[i] == Started;
+    }
+    totals.started.fetch_add(started, std::memory_order_relaxed);
+    totals.fallen.fetch_add(fallen, std::memory_order_relaxed);
+}
+
+
+/**
+ * @param i The index of the car.
+ * @return The state of car i.
+ */
+GondolaState GondolaFleet::getState(const size_t i) const {
+    return static_cast<GondolaState>(state_[i]);
+}
+
+
+/**
+ * @param i The index of the car.
+ * @param alpha Interpolation factor between the previous (0) and the current
+ * (1) physics state, as in draw.
+ * @return The position of the center of car i, after the last step by
+ * default.
+ */
+vec2 GondolaFleet::getPosition(const size_t i, const float alpha) const {
+    const float a = state_[i] == Started ? alpha : 1.0f;
+    return vec2(mix(previousPositionX_[i], positionX_[i], a),
+                mix(previousPositionY_[i], positionY_[i], a));
+}
+
+
+/**
+ * @return The number of cars currently in the Started state.
+ */
+size_t GondolaFleet::startedCount() const { return startedCount_; }
+
+
+/**
+ * @return The number of cars that fell during the last animateAll.
+ */
+size_t GondolaFleet::fallenLastStep() const { return fallenCount_; }
+
+
+/**
+ * @brief Makes room for count instances in the instance stream.
+ *
+ * The mesh is drawn through a VAO of its own, attached to the vertex arena
+ * for the mesh vertices and reading the instance stream through binding 1.
+ * When the stream recreates its buffer, binding 1 is pointed to the new one.
+ *
+ * @param count The number of instances needed.
+ */
+void GondolaFleet::reserveInstances(const size_t count) {
+    if (instancedVao_ == 0) {
+        glCreateVertexArrays(1, &instancedVao_);
+        VertexArena<vec2>::get().attach(instancedVao_);
+        mesh_.setVertexArray(instancedVao_);
+
+        glEnableVertexArrayAttrib(instancedVao_, 1);
+        glVertexArrayAttribFormat(instancedVao_, 1, 3, GL_FLOAT, GL_FALSE,
+                                  offsetof(GondolaInstance, position));
+        glVertexArrayAttribBinding(instancedVao_, 1, 1);
+        glEnableVertexArrayAttrib(instancedVao_, 2);
+        glVertexArrayAttribFormat(instancedVao_, 2, 4, GL_UNSIGNED_BYTE,
+                                  GL_TRUE, offsetof(GondolaInstance, color));
+        glVertexArrayAttribBinding(instancedVao_, 2, 1);
+        glVertexArrayBindingDivisor(instancedVao_, 1, 1);
+    }
+    if (instances_.reserve(count))
+        glVertexArrayVertexBuffer(instancedVao_, 1, instances_.buffer(), 0,
+                                  sizeof(GondolaInstance));
+}
+
+
+/**
+ * @brief Draws every car that is not Waiting with instancing.
+ *
+ * Sets the MVP uniform of the shader and draws the cars through
+ * uploadInstances and drawInstances.
+ *
+ * @param shader The instanced GPU program used for rendering.
+ * @param MVP The model-view-projection matrix of the scene.
+ * @param alpha Interpolation factor between the previous (0) and the current
+ * (1) physics state, see glApp::interpolationAlpha.
+ */
+void GondolaFleet::draw(GPUProgram* shader, const mat4& MVP,
+                        const float alpha) {
+    ProfileZone zone("GondolaFleet::draw", true);
+    uploadInstances(alpha);
+    if (drawCount_ == 0)
+        return;
+    shader->setUniform(MVP, shader->uniform("MVP"));
+    drawInstances(shader);
+    endDraws();
+}
+
+
+/**
+ * @brief Prepares the cars for the draws of one frame.
+ *
+ * The interpolated position, rotation and color of the cars that are not
+ * Waiting are written into the next region of the instance stream. In GPU
+ * physics mode the cars are drawn from the car buffer instead, so nothing is
+ * written and only a car buffer changed on the CPU is uploaded.
+ *
+ * @param alpha Interpolation factor between the previous (0) and the current
+ * (1) physics state, see glApp::interpolationAlpha.
+ */
+void GondolaFleet::uploadInstances(const float alpha) {
+    drawAlpha_ = alpha;
+    drawCount_ = 0;
+    if (gpuPhysics_ != nullptr) {
+        if (size() > 0 && !gpuCurrent_)
+            uploadCars();
+        drawCount_ = static_cast<int>(size());
+        return;
+    }
+    reserveInstances(size());
+    GondolaInstance* const instances = instances_.beginWrite(size());
+    if (instances == nullptr)
+        return;
+
+    int count = 0;
+    for (size_t i = 0; i < size(); i++) {
+        if (state_[i] == Waiting)
+            continue;
+
+        const float a = state_[i] == Started ? alpha : 1.0f;
+        GondolaInstance& instance = instances[count++];
+        instance.position =
+            vec2(mix(previousPositionX_[i], positionX_[i], a),
+                 mix(previousPositionY_[i], positionY_[i], a));
+        instance.rotation =
+            mix(previousRotationAngle_[i], rotationAngle_[i], a);
+        instance.color = color_[i];
+    }
+    drawCount_ = count;
+}
+
+
+/**
+ * @brief Draws the cars prepared by the last uploadInstances.
+ *
+ * The body, rim and spokes of all cars are drawn with one instanced draw call
+ * each. The bodies take the instance colors (useInstanceColor) and the lines
+ * the uniform color. On the CPU the shader reads the position and rotation
+ * from attribute 1 and the color from attribute 2 of the region written by
+ * uploadInstances. In GPU physics mode it reads one car per instance from
+ * storage buffer binding 0, interpolates it by the alpha uniform and moves
+ * Waiting cars out of the clip volume. The MVP is left to the caller, so the
+ * cars may be drawn once per view.
+ *
+ * @param shader The instanced GPU program used for rendering, in use.
+ */
+void GondolaFleet::drawInstances(GPUProgram* shader) {
+    if (drawCount_ == 0)
+        return;
+    const UniformHandle color = shader->uniform("color");
+    const UniformHandle useInstanceColor = shader->uniform("useInstanceColor");
+    unsigned int base = 0;
+    if (gpuPhysics_ != nullptr) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, carBuffer_);
+        shader->setUniform(drawAlpha_, shader->uniform("alpha"));
+    } else {
+        base = instances_.first();
+    }
+
+    shader->setUniform(1, useInstanceColor);
+    mesh_.Draw(shader, GL_TRIANGLE_FAN, bodyColor, color, Gondola::bodyFirst,
+               Gondola::bodyCount, drawCount_, base);
+    shader->setUniform(0, useInstanceColor);
+    mesh_.Draw(shader, GL_LINE_LOOP, vec3(1, 1, 1), color, Gondola::rimFirst,
+               Gondola::rimCount, drawCount_, base);
+    mesh_.Draw(shader, GL_LINES, vec3(1, 1, 1), color, Gondola::spokesFirst,
+               Gondola::spokesCount, drawCount_, base);
+}
+
+
+/**
+ * @brief Marks the instances as read by the draws issued so far, see
+ * StreamGeometry::endDraws. Called after the last drawInstances of a frame.
+ */
+void GondolaFleet::endDraws() {
+    if (gpuPhysics_ == nullptr && drawCount_ > 0)
+        instances_.endDraws();
+}
+
+
+/**
+ * @brief Moves the physics of the fleet to the GPU, or back to the CPU.
+ *
+ * The program is a compute shader of 64 invocations per work group that
+ * advances car gl_GlobalInvocationID by the physics of animateRange. It
+ * reads and writes the GPUCar array at storage buffer binding 0, reads the
+ * CubicSegment coefficients at binding 1 and the arc length table at binding
+ * 2, and counts the cars at binding 3 (GPUCarCounters). While it is set,
+ * draw expects a program reading the cars from binding 0, and getState and
+ * getPosition report the state of the last download. Switching back to the
+ * CPU downloads the cars. Ignored for a spline without GPU resources, like
+ * Spline::setGPUEvaluation.
+ *
+ * @param program The compute program, or nullptr for CPU physics.
+ */
+void GondolaFleet::setGPUPhysics(GPUProgram* program) {
+    if (!spline_->isRenderable() || program == gpuPhysics_)
+        return;
+    if (program == nullptr) {
+        if (!cpuCurrent_)
+            downloadCars();
+    } else {
+        createGPUBuffers();
+        gpuCurrent_ = false;
+    }
+    gpuPhysics_ = program;
+}
+
+
+/**
+ * @return True if the cars are stepped on the GPU, see setGPUPhysics.
+ */
+bool GondolaFleet::usesGPUPhysics() const { return gpuPhysics_ != nullptr; }
+
+
+/**
+ * @brief Creates the buffers of the GPU physics on first use.
+ *
+ * The readback buffer is mapped persistently, so reading the counters of a
+ * finished step is a plain memory read.
+ */
+void GondolaFleet::createGPUBuffers() {
+    if (readbackBuffer_ != 0)
+        return;
+    glCreateBuffers(1, &carBuffer_);
+    glCreateBuffers(1, &segmentBuffer_);
+    glCreateBuffers(1, &arcLengthBuffer_);
+    glCreateBuffers(1, &counterBuffer_);
+    glNamedBufferData(counterBuffer_, sizeof(GPUCarCounters), nullptr,
+                      GL_DYNAMIC_COPY);
+
+    constexpr GLsizeiptr bytes = readbackSlots * sizeof(GPUCarCounters);
+    constexpr GLbitfield flags =
+        GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &readbackBuffer_);
+    glNamedBufferStorage(readbackBuffer_, bytes, nullptr, flags);
+    readback_ = static_cast<const GPUCarCounters*>(
+        glMapNamedBufferRange(readbackBuffer_, 0, bytes, flags));
+}
+
+
+/**
+ * @brief Copies the CPU state of every car into the car buffer.
+ *
+ * The counters restart from the CPU started count, and readbacks still in
+ * flight are dropped, since they count the cars before the upload.
+ */
+void GondolaFleet::uploadCars() {
+    const size_t n = size();
+    std::vector<GPUCar> cars(n);
+    for (size_t i = 0; i < n; i++)
+        cars[i] = {progressAlongSpline_[i],
+                   distanceAlongSpline_[i],
+                   velocity_[i],
+                   rotationAngle_[i],
+                   vec2(positionX_[i], positionY_[i]),
+                   vec2(previousPositionX_[i], previousPositionY_[i]),
+                   previousRotationAngle_[i],
+                   state_[i],
+                   color_[i],
+                   energy_[i]};
+    if (n > carCapacity_) {
+        carCapacity_ = std::max(n, 2 * carCapacity_);
+        glNamedBufferData(carBuffer_,
+                          static_cast<GLsizeiptr>(carCapacity_ *
+                                                  sizeof(GPUCar)),
+                          nullptr, GL_DYNAMIC_COPY);
+    }
+    if (n > 0)
+        glNamedBufferSubData(carBuffer_, 0,
+                             static_cast<GLsizeiptr>(n * sizeof(GPUCar)),
+                             cars.data());
+
+    const GPUCarCounters counters{static_cast<uint32_t>(startedCount_), 0};
+    glNamedBufferSubData(counterBuffer_, 0, sizeof(counters), &counters);
+    fallenRead_ = 0;
+    for (GLsync& fence : readbackFences_) {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    gpuCurrent_ = cpuCurrent_ = true;
+}
+
+
+/**
+ * @brief Copies the car buffer back into the CPU arrays.
+ *
+ * Waits for the GPU, so it only runs when the cars are changed on the CPU or
+ * the physics returns to the CPU. A car whose distance or position is not
+ * finite is taken as Fallen, so a broken step never shows as a moving car.
+ */
+void GondolaFleet::downloadCars() {
+    const size_t n = size();
+    std::vector<GPUCar> cars(n);
+    if (n > 0)
+        glGetNamedBufferSubData(carBuffer_, 0,
+                                static_cast<GLsizeiptr>(n * sizeof(GPUCar)),
+                                cars.data());
+    startedCount_ = 0;
+    for (size_t i = 0; i < n; i++) {
+        const GPUCar& car = cars[i];
+        progressAlongSpline_[i] = car.progress;
+        distanceAlongSpline_[i] = car.distance;
+        velocity_[i] = car.velocity;
+        rotationAngle_[i] = car.rotation;
+        positionX_[i] = car.position.x;
+        positionY_[i] = car.position.y;
+        previousPositionX_[i] = car.previousPosition.x;
+        previousPositionY_[i] = car.previousPosition.y;
+        previousRotationAngle_[i] = car.previousRotation;
+        energy_[i] = car.energy;
+        const bool finite = std::isfinite(car.distance) &&
+                            std::isfinite(car.position.x) &&
+                            std::isfinite(car.position.y);
+        state_[i] = finite ? static_cast<uint8_t>(car.state)
+                           : static_cast<uint8_t>(Fallen);
+        startedCount_ += state_[i] == Started;
+    }
+    cpuCurrent_ = true;
+}
+
+
+/**
+ * @brief Copies the segment and arc length tables of the spline to the GPU
+ * if the spline changed since the last copy.
+ *
+ * The arc length table is copied as double, so the shader maps distances
+ * to spline parameters as precisely as sToT on long tracks; the segment
+ * coefficients are float on both sides.
+ */
+void GondolaFleet::uploadSpline() {
+    if (splineUploaded_ && splineRevision_ == spline_->getRevision())
+        return;
+    const std::vector<CubicSegment>& segments = spline_->getSegments();
+    const std::vector<double>& arcLengths = spline_->getArcLengths();
+    glNamedBufferData(segmentBuffer_,
+                      static_cast<GLsizeiptr>(
+                          std::max<size_t>(segments.size(), 1) *
+                          sizeof(CubicSegment)),
+                      segments.data(), GL_STATIC_DRAW);
+    glNamedBufferData(arcLengthBuffer_,
+                      static_cast<GLsizeiptr>(
+                          std::max<size_t>(arcLengths.size(), 1) *
+                          sizeof(double)),
+                      arcLengths.data(), GL_STATIC_DRAW);
+    splineRevision_ = spline_->getRevision();
+    splineUploaded_ = true;
+}
+
+
+/**
+ * @brief Takes the counts of the latest finished step whose counters were
+ * read back.
+ *
+ * Never waits: slots whose copy has not finished are left for a later call.
+ * The started count is that of the step read; the cars fallen since the
+ * previous read are added to fallenLastStep.
+ */
+void GondolaFleet::readCounters() {
+    int latest = -1;
+    for (int slot = 0; slot < readbackSlots; slot++) {
+        GLsync& fence = readbackFences_[slot];
+        if (fence == nullptr)
+            continue;
+        const GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+        glDeleteSync(fence);
+        fence = nullptr;
+        if (latest < 0 || readbackSteps_[slot] > readbackSteps_[latest])
+            latest = slot;
+    }
+    if (latest < 0)
+        return;
+    startedCount_ = readback_[latest].started;
+    fallenCount_ += readback_[latest].fallen - fallenRead_;
+    fallenRead_ = readback_[latest].fallen;
+}
+
+
+/**
+ * @brief Advances every started car by dt on the GPU.
+ *
+ * The cars, uploaded only after changes on the CPU, and the spline tables,
+ * uploaded only after edits, stay on the GPU; a step is a few uniforms and
+ * one dispatch. The counters of the step are then copied into the next
+ * readback slot, unless that slot is still in flight, in which case a later
+ * step reports them.
+ *
+ * @param dt The elapsed time since the last animation update.
+ */
+void GondolaFleet::animateGPU(const float dt) {
+    fallenCount_ = 0;
+    readCounters();
+    const size_t n = size();
+    if (startedCount_ == 0 || n == 0)
+        return;
+    if (!gpuCurrent_)
+        uploadCars();
+    uploadSpline();
+
+    GPUProgram* const program = gpuPhysics_;
+    program->Use();
+    program->setUniform(static_cast<int>(n), "carCount");
+    program->setUniform(static_cast<int>(spline_->getSegments().size()),
+                        "segmentCount");
+    program->setUniform(static_cast<int>(spline_->getArcLengths().size()),
+                        "arcLengthCount");
+    program->setUniform(Spline::arcLengthSubdivisions, "subdivisions");
+    program->setUniform(dt, "dt");
+    program->setUniform(radius_, "radius");
+    program->setUniform(Gondola::GRAVITY, "gravity");
+    program->setUniform(Gondola::EPSILON, "epsilon");
+
+    // The started count is recounted by every step, fallen accumulates
+    glClearNamedBufferSubData(counterBuffer_, GL_R32UI, 0, sizeof(uint32_t),
+                              GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, carBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, segmentBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, arcLengthBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer_);
+    glDispatchCompute(static_cast<GLuint>((n + 63) / 64), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT |
+                    GL_BUFFER_UPDATE_BARRIER_BIT);
+    cpuCurrent_ = false;
+
+    gpuStep_++;
+    const int slot = static_cast<int>(gpuStep_ % readbackSlots);
+    if (readbackFences_[slot] == nullptr) {
+        glCopyNamedBufferSubData(
+            counterBuffer_, readbackBuffer_, 0,
+            static_cast<GLintptr>(slot * sizeof(GPUCarCounters)),
+            sizeof(GPUCarCounters));
+        readbackFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readbackSteps_[slot] = gpuStep_;
+    }
+}
@@ -0,0 +1,215 @@
+#ifndef GONDOLAFLEET_H
+#define GONDOLAFLEET_H
+
+#include "Gondola.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+
+/**
+ * @brief Allocator aligning arrays to the cache line, so that chunks of a
+ * multiple of GondolaFleet::chunkGrain cars start on a line boundary.
+ */
+template <class T> struct CacheLineAllocator {
+    using value_type = T;
+    static constexpr std::align_val_t alignment{64};
+
+    CacheLineAllocator() = default;
+    template <class U> CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), alignment));
+    }
+    void deallocate(T* p, size_t) { ::operator delete(p, alignment); }
+
+    template <class U> bool operator==(const CacheLineAllocator<U>&) const {
+        return true;
+    }
+};
+
+template <class T> using AlignedVector = std::vector<T, CacheLineAllocator<T>>;
+
+
+// Per-instance attributes of a car drawn by GondolaFleet::draw
+struct GondolaInstance {
+    vec2 position;
+    float rotation;
+    uint32_t color; // RGBA8
+};
+
+
+// State of a car in the storage buffer of the GPU physics, see
+// GondolaFleet::setGPUPhysics. Mirrored by the Car struct of the shaders.
+// The spline parameter and distance are double, like on the CPU.
+struct GPUCar {
+    double progress, distance;
+    float velocity, rotation;
+    vec2 position, previousPosition;
+    float previousRotation;
+    uint32_t state; // GondolaState
+    uint32_t color; // RGBA8
+    float energy;   // see GondolaFleet::startAt
+};
+
+static_assert(sizeof(GPUCar) == 56, "std430 layout of the Car struct");
+
+
+// Counters written by the physics shader, read back without stalling
+struct GPUCarCounters {
+    uint32_t started; // cars Started after the last step
+    uint32_t fallen;  // cars fallen since the last upload
+};
+
+
+/**
+ * @class GondolaFleet
+ * @brief Simulates many gondolas sharing one spline.
+ *
+ * The per-car state is stored as structure-of-arrays: every field of Gondola
+ * lives in its own contiguous array indexed by car. animateAll advances all
+ * cars in passes over these arrays: the spline is sampled for every moving
+ * car, the forces are evaluated in a branch-free loop the compiler can
+ * vectorize, and finally the distances are mapped back to spline parameters.
+ * Each car keeps the Waiting, Started and Fallen semantics of Gondola.
+ *
+ * Given a JobSystem, animateAll runs the passes on cache-line-aligned chunks
+ * of cars in parallel; the spline is only read during a step.
+ *
+ * All cars are drawn with instancing from one shared mesh, so the number of
+ * draw calls does not depend on the size of the fleet. The per-car
+ * GondolaInstance attributes are streamed through a StreamGeometry.
+ *
+ * In GPU physics mode the cars live in a shader storage buffer of GPUCar,
+ * stepped by a compute shader against a copy of the spline tables, and the
+ * instanced shader reads them from there, so a step moves no car data
+ * between the CPU and the GPU. Only the started and fallen counts come back,
+ * a few steps late, through a ring of fenced readback slots. Changing a car
+ * on the CPU downloads the fleet first and uploads it again on the next step.
+ *
+ * draw is uploadInstances, drawInstances and endDraws in one; several views
+ * of a frame upload the instances once and draw them once per view.
+ */
+class GondolaFleet {
+
+  public:
+    // Cars per chunk: a cache line of the byte arrays and four of the floats
+    static constexpr size_t chunkGrain = 64;
+
+  private:
+    const Spline* spline_;
+    float radius_;
+
+    AlignedVector<double> progressAlongSpline_;
+    AlignedVector<double> distanceAlongSpline_;
+    AlignedVector<float> velocity_;
+    AlignedVector<float> energy_; // GRAVITY times the height of rest
+    AlignedVector<float> positionX_, positionY_;
+    AlignedVector<float> rotationAngle_;
+    AlignedVector<float> previousPositionX_, previousPositionY_;
+    AlignedVector<float> previousRotationAngle_;
+    AlignedVector<uint8_t> state_;
+    AlignedVector<uint32_t> color_;
+    AlignedVector<int> segmentHint_;
+    AlignedVector<int> distanceHint_;
+    size_t startedCount_ = 0;
+    size_t fallenCount_ = 0;
+
+    // Spline samples of the current step
+    AlignedVector<float> sampleX_, sampleY_;
+    AlignedVector<float> tangentX_, tangentY_;
+    AlignedVector<float> secondX_, secondY_;
+    AlignedVector<uint8_t> moved_;
+
+    struct StepTotals {
+        std::atomic<size_t> started = 0;
+        std::atomic<size_t> fallen = 0;
+    };
+
+    void animateRange(size_t begin, size_t end, float dt, StepTotals& totals);
+
+    void reserveInstances(size_t count);
+
+    Geometry<vec2> mesh_;
+    StreamGeometry<GondolaInstance> instances_;
+    unsigned int instancedVao_ = 0; // mesh and instance attributes
+    int drawCount_ = 0;             // instances of the last uploadInstances
+    float drawAlpha_ = 1.0f;
+
+    // GPU physics, see setGPUPhysics
+    static constexpr int readbackSlots = 3;
+    GPUProgram* gpuPhysics_ = nullptr;
+    unsigned int carBuffer_ = 0;
+    unsigned int segmentBuffer_ = 0, arcLengthBuffer_ = 0;
+    unsigned int counterBuffer_ = 0, readbackBuffer_ = 0;
+    const GPUCarCounters* readback_ = nullptr; // mapped readbackBuffer_
+    GLsync readbackFences_[readbackSlots] = {};
+    size_t readbackSteps_[readbackSlots] = {};
+    size_t carCapacity_ = 0;
+    size_t gpuStep_ = 0;
+    uint32_t fallenRead_ = 0;
+    size_t splineRevision_ = 0;
+    bool splineUploaded_ = false;
+    bool gpuCurrent_ = false; // the car buffer holds the CPU state
+    bool cpuCurrent_ = true;  // the CPU arrays hold the GPU state
+
+    void createGPUBuffers();
+
+    void uploadCars();
+
+    void downloadCars();
+
+    void uploadSpline();
+
+    void readCounters();
+
+    void animateGPU(float dt);
+
+
+  public:
+    explicit GondolaFleet(const Spline* spline, float radius = 1.0f);
+
+    ~GondolaFleet();
+
+    GondolaFleet(const GondolaFleet&) = delete;
+    GondolaFleet& operator=(const GondolaFleet&) = delete;
+
+    void resize(size_t count);
+
+    size_t size() const;
+
+    void start(size_t i);
+
+    void startAt(size_t i, double distance);
+
+    void setColor(size_t i, vec3 color);
+
+    void animateAll(float dt, JobSystem* jobs = nullptr);
+
+    void rebase(vec2 offset);
+
+    void setGPUPhysics(GPUProgram* program);
+
+    bool usesGPUPhysics() const;
+
+    GondolaState getState(size_t i) const;
+
+    vec2 getPosition(size_t i, float alpha = 1.0f) const;
+
+    size_t startedCount() const;
+
+    size_t fallenLastStep() const;
+
+    void draw(GPUProgram* shader, const mat4& MVP, float alpha = 1.0f);
+
+    void uploadInstances(float alpha = 1.0f);
+
+    void drawInstances(GPUProgram* shader);
+
+    void endDraws();
+};
+
+
+#endif // GONDOLAFLEET_H
@@ -0,0 +1,242 @@
+#include "Gondola.h"
+#include "JobSystem.h"
+#include "TrackFile.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+
+// Outcome of the simulation of one track
+struct TrackResult {
+    bool loaded = false;
+    bool stalled = false;  // stopped climbing for lack of energy
+    GondolaState state = Waiting;
+    float time = 0.0f;     // simulated seconds until the fall
+    dvec2 position{0, 0};  // center of the gondola at the fall, in world
+                           // coordinates
+    double distance = 0.0; // arc length travelled
+    double length = 0.0;   // arc length of the track
+};
+
+
+/**
+ * @brief Runs the gondola physics on one track without rendering.
+ *
+ * The track is loaded into a spline that is not renderable, so no GL context
+ * is needed, and the gondola is stepped with a fixed time step as fast as
+ * possible until it falls, stalls or maxTime elapses. The origin of the
+ * spline follows the gondola like in the app, see Spline::rebaseOffset, so
+ * the physics is as precise at the end of a long track as at its start.
+ *
+ * @param path The path of the track file, see loadTrack.
+ * @param dt The physics time step in seconds.
+ * @param integrator How the gondola integrates each step.
+ * @param tolerance The arc length error per adaptive substep.
+ * @param maxTime The simulated time after which a moving gondola is given up.
+ * @return The state of the gondola and where and when it stopped.
+ */
+static TrackResult simulate(const std::string& path, const float dt,
+                            const GondolaIntegrator integrator,
+                            const float tolerance, const float maxTime) {
+    TrackResult result;
+    Spline spline(false);
+    if (!loadTrack(path, spline))
+        return result;
+    if (spline.getControlPoints().size() < 2) {
+        fprintf(stderr, "Track %s has fewer than two control points\n",
+                path.c_str());
+        return result;
+    }
+    result.loaded = true;
+
+    Gondola gondola(&spline);
+    gondola.setIntegrator(integrator, tolerance);
+    spline.rebase(Spline::rebaseOffset(spline.evaluate(0.0)));
+    gondola.start();
+
+    // A climb above the start height has no real velocity, the gondola
+    // stalls there and the state before the climb is reported
+    const int maxSteps = static_cast<int>(ceilf(maxTime / dt));
+    int steps = 0;
+    result.position = spline.getOrigin() + dvec2(gondola.getPosition());
+    while (gondola.getState() == Started && steps < maxSteps) {
+        gondola.animate(dt);
+        if (gondola.hasStalled()) {
+            result.stalled = true;
+            break;
+        }
+        result.position = spline.getOrigin() + dvec2(gondola.getPosition());
+        result.distance = gondola.getDistance();
+        const vec2 offset = Spline::rebaseOffset(gondola.getPosition());
+        spline.rebase(offset);
+        gondola.rebase(offset);
+        steps++;
+    }
+
+    result.state = gondola.getState();
+    result.time = steps * dt;
+    result.length = spline.getLength();
+    return result;
+}
+
+
+/**
+ * @brief Converts a track to the binary format, with the precomputed tables.
+ *
+ * The binary track is written next to the input, with the extension .trk.
+ *
+ * @param path The path of the track file, see loadTrack.
+ * @return False if the track cannot be read or written.
+ */
+static bool convert(const std::string& path) {
+    fs::path output(path);
+    output.replace_extension(".trk");
+    if (output == fs::path(path)) {
+        fprintf(stderr, "Track %s is already binary\n", path.c_str());
+        return false;
+    }
+    Spline spline(false);
+    return loadTrack(path, spline) &&
+           writeBinaryTrack(output.string(), spline, true);
+}
+
+
+/**
+ * @brief Describes how the simulation of a track ended.
+ *
+ * @param result The outcome of the simulation.
+ * @return "error" if the track could not be loaded, "end" if the gondola ran
+ * off the end of the track, "fall" if it fell off the track before, "stall"
+ * if it could not climb higher than its start, and "running" if it was still
+ * moving when the simulation was given up.
+ */
+static const char* outcome(const TrackResult& result) {
+    if (!result.loaded)
+        return "error";
+    if (result.stalled)
+        return "stall";
+    if (result.state != Fallen)
+        return "running";
+    return result.distance > result.length ? "end" : "fall";
+}
+
+
+/**
+ * @brief Parses the name of an integrator.
+ *
+ * @param name "euler", "rk4" or "adaptive".
+ * @param integrator Receives the integrator.
+ * @return False if the name is unknown.
+ */
+static bool parseIntegrator(const char* name, GondolaIntegrator& integrator) {
+    if (strcmp(name, "euler") == 0)
+        integrator = EulerIntegrator;
+    else if (strcmp(name, "rk4") == 0)
+        integrator = RK4Integrator;
+    else if (strcmp(name, "adaptive") == 0)
+        integrator = AdaptiveIntegrator;
+    else
+        return false;
+    return true;
+}
+
+
+/**
+ * @brief Prints the command line usage.
+ */
+static void printUsage() {
+    printf("Usage: gondola_sim [--dt seconds] [--max-time seconds] "
+           "[--integrator euler|rk4|adaptive]\n"
+           "                  [--tolerance distance] [--threads count] "
+           "[--convert] track...\n"
+           "Simulates a gondola on every text or binary track without "
+           "rendering and prints\none CSV line per track. With --convert "
+           "the tracks are written as binary .trk\nfiles instead. The "
+           "adaptive integrator keeps the arc length error of each\n"
+           "substep below the tolerance, so it allows a longer --dt.\n");
+}
+
+
+/**
+ * @brief Validates tracks offline: runs the gondola on every track given on
+ * the command line, in parallel, and prints the fall time and location.
+ *
+ * @return 0 on success, 1 if a track could not be loaded (or converted), 2 on
+ * invalid arguments.
+ */
+int main(const int argc, char* argv[]) {
+    float dt = 0.01f;
+    float maxTime = 600.0f;
+    GondolaIntegrator integrator = EulerIntegrator;
+    float tolerance = 1e-3f;
+    size_t threads = JobSystem::defaultThreadCount();
+    bool converting = false;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--dt") == 0 && hasValue)
+            dt = strtof(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--max-time") == 0 && hasValue)
+            maxTime = strtof(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--integrator") == 0 && hasValue) {
+            if (!parseIntegrator(argv[++i], integrator)) {
+                printUsage();
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+            tolerance = strtof(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+            threads = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--convert") == 0)
+            converting = true;
+        else if (argv[i][0] == '-') {
+            printUsage();
+            return 2;
+        } else
+            paths.emplace_back(argv[i]);
+    }
+    if (paths.empty() || dt <= 0.0f || maxTime <= 0.0f ||
+        !(tolerance > 0.0f)) {
+        printUsage();
+        return 2;
+    }
+
+    JobSystem jobs(threads);
+    if (converting) {
+        std::vector<uint8_t> converted(paths.size());
+        jobs.parallelFor(paths.size(), 1,
+                         [&](const size_t first, const size_t end) {
+                             for (size_t i = first; i < end; i++)
+                                 converted[i] = convert(paths[i]);
+                         });
+        return std::count(converted.begin(), converted.end(), 0) == 0 ? 0 : 1;
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<TrackResult> results(paths.size());
+    jobs.parallelFor(paths.size(), 1,
+                     [&](const size_t first, const size_t end) {
+                         for (size_t i = first; i < end; i++)
+                             results[i] = simulate(paths[i], dt, integrator,
+                                                   tolerance, maxTime);
+                     });
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+
+    int status = 0;
+    printf("track,outcome,time,x,y,distance,length\n");
+    for (size_t i = 0; i < paths.size(); i++) {
+        const TrackResult& r = results[i];
+        printf("%s,%s,%.3f,%.3f,%.3f,%.3f,%.3f\n", paths[i].c_str(),
+               outcome(r), r.time, r.position.x, r.position.y, r.distance,
+               r.length);
+        if (!r.loaded)
+            status = 1;
+    }
+    fprintf(stderr, "%zu tracks in %.3f s on %zu threads\n", paths.size(),
+            elapsed.count(), jobs.threadCount() + 1);
+    return status;
+}
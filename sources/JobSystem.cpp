@@ -0,0 +1,164 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param threadCount The number of worker threads. With zero threads
+ * parallelFor runs everything on the calling thread.
+ */
+JobSystem::JobSystem(const size_t threadCount) {
+    for (size_t i = 0; i < threadCount; i++)
+        queues_.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threadCount; i++)
+        threads_.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+
+/**
+ * @brief Stops and joins the worker threads.
+ */
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_)
+        thread.join();
+}
+
+
+/**
+ * @return One worker per hardware thread besides the calling one.
+ */
+size_t JobSystem::defaultThreadCount() {
+    const unsigned hardware = std::thread::hardware_concurrency();
+    return hardware > 1 ? hardware - 1 : 0;
+}
+
+
+/**
+ * @return The number of worker threads.
+ */
+size_t JobSystem::threadCount() const { return threads_.size(); }
+
+
+/**
+ * @brief Takes the most recently queued job of a queue.
+ *
+ * @param queue The index of the queue.
+ * @param job Receives the job.
+ * @return True if a job was taken.
+ */
+bool JobSystem::pop(const size_t queue, Job& job) {
+    Queue& q = *queues_[queue];
+    std::lock_guard lock(q.mutex);
+    if (q.jobs.empty())
+        return false;
+    job = q.jobs.back();
+    q.jobs.pop_back();
+    queued_--;
+    return true;
+}
+
+
+/**
+ * @brief Takes the oldest job of the first non-empty queue after the thief's.
+ *
+ * @param thief The index of the stealing worker; threadCount() for the
+ * calling thread of parallelFor.
+ * @param job Receives the job.
+ * @return True if a job was taken.
+ */
+bool JobSystem::steal(const size_t thief, Job& job) {
+    const size_t n = queues_.size();
+    for (size_t k = 1; k <= n; k++) {
+        Queue& q = *queues_[(thief + k) % n];
+        std::lock_guard lock(q.mutex);
+        if (q.jobs.empty())
+            continue;
+        job = q.jobs.front();
+        q.jobs.pop_front();
+        queued_--;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Executes a job and marks its chunk as finished.
+ *
+ * @param job The job to execute.
+ */
+void JobSystem::run(const Job& job) {
+    (*job.task->body)(job.begin, job.end);
+    job.task->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Executes jobs until the system is destroyed, sleeping while every
+ * queue is empty.
+ *
+ * @param index The index of the worker and of its queue.
+ */
+void JobSystem::workerLoop(const size_t index) {
+    Job job;
+    while (true) {
+        if (pop(index, job) || steal(index, job)) {
+            run(job);
+            continue;
+        }
+        std::unique_lock lock(sleepMutex_);
+        wake_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+        if (stopping_)
+            return;
+    }
+}
+
+
+/**
+ * @brief Calls body on chunks of [0, count) in parallel and waits for them.
+ *
+ * The chunk boundaries are multiples of grain, so a grain matching the cache
+ * line keeps the chunks of different threads from sharing lines. The calling
+ * thread executes chunks as well, so parallelFor may be nested inside a job.
+ *
+ * @param count The size of the range.
+ * @param grain The size of a chunk, the last one may be shorter.
+ * @param body Called with the begin and end of each chunk.
+ */
+void JobSystem::parallelFor(const size_t count, size_t grain,
+                            const RangeFunction& body) {
+    grain = std::max<size_t>(grain, 1);
+    const size_t chunks = (count + grain - 1) / grain;
+    if (chunks <= 1 || queues_.empty()) {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    Task task{&body, chunks};
+    for (size_t c = 0; c < chunks; c++) {
+        Queue& q = *queues_[c % queues_.size()];
+        std::lock_guard lock(q.mutex);
+        q.jobs.push_back({&task, c * grain, std::min(count, (c + 1) * grain)});
+        queued_++;
+    }
+    {
+        std::lock_guard lock(sleepMutex_);
+    }
+    wake_.notify_all();
+
+    Job job;
+    while (task.remaining.load(std::memory_order_acquire) > 0) {
+        if (steal(queues_.size(), job))
+            run(job);
+        else
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @class JobSystem
+ * @brief A small thread pool with work-stealing job queues.
+ *
+ * Every worker thread owns a deque of jobs. A worker pops jobs from the back
+ * of its own deque and, when it runs dry, steals from the front of the other
+ * deques, so the load evens out without a central queue. parallelFor splits a
+ * range into chunks, deals them to the deques and helps to execute them on the
+ * calling thread until every chunk has finished.
+ */
+class JobSystem {
+
+  public:
+    using RangeFunction = std::function<void(size_t begin, size_t end)>;
+
+  private:
+    // A parallelFor call shared by all of its chunks
+    struct Task {
+        const RangeFunction* body;
+        std::atomic<size_t> remaining;
+    };
+
+    struct Job {
+        Task* task;
+        size_t begin, end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> queued_ = 0;
+    std::atomic<bool> stopping_ = false;
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+
+    bool pop(size_t queue, Job& job);
+
+    bool steal(size_t thief, Job& job);
+
+    static void run(const Job& job);
+
+    void workerLoop(size_t index);
+
+  public:
+    explicit JobSystem(size_t threadCount = defaultThreadCount());
+
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    static size_t defaultThreadCount();
+
+    size_t threadCount() const;
+
+    void parallelFor(size_t count, size_t grain, const RangeFunction& body);
+};
+
+
+#endif // JOBSYSTEM_H
@@ -1,18 +1,287 @@
+#include "BatchRenderer.h"
 #include "Camera.h"
 #include "Gondola.h"
+#include "GondolaFleet.h"
+#include "JobSystem.h"
 #include "Spline.h"
+#include "TextureLoader.h"
+#include "ViewSet.h"
 
+#ifndef ASSET_DIR
+#    define ASSET_DIR "assets/"
+#endif
 
+
+// Draws the merged vertex stream of BatchRenderer with per-vertex colors. The
+// programs of the scene take their MVP from the View block of the view being
+// drawn, see ViewSet.
 const char* vertexSource = R"(
     #version 330
     layout(location = 0) in vec2 cP;
-    uniform mat4 MVP;
+    layout(location = 1) in vec4 cC;
+    layout(std140) uniform View { mat4 MVP; }; // ViewBlock
+    out vec3 vertexColor;
+    void main() {
+        vertexColor = cC.rgb;
+        gl_Position = MVP * vec4(cP, 0.0, 1.0);
+    }
+)";
+
+
+// Draws the curve and control point geometry kept by the spline with a
+// uniform color, see Spline::drawView
+const char* lineVertexSource = R"(
+    #version 330
+    layout(location = 0) in vec2 cP;
+    layout(std140) uniform View { mat4 MVP; }; // ViewBlock
     void main() {
         gl_Position = MVP * vec4(cP, 0.0, 1.0);
     }
 )";
 
 
+// Evaluates the curve from the segment coefficients, see
+// Spline::setGPUEvaluation. Vertex i belongs to segment i / samplesPerSegment.
+const char* curveVertexSource = R"(
+    #version 330
+    uniform samplerBuffer segments;
+    uniform int segmentCount;
+    uniform int samplesPerSegment;
+    layout(std140) uniform View { mat4 MVP; }; // ViewBlock
+    void main() {
+        int segment = min(gl_VertexID / samplesPerSegment, segmentCount - 1);
+        float s = float(gl_VertexID - segment * samplesPerSegment) /
+                  float(samplesPerSegment);
+        vec4 c01 = texelFetch(segments, 2 * segment);
+        vec4 c23 = texelFetch(segments, 2 * segment + 1);
+        vec2 p = ((c23.zw * s + c23.xy) * s + c01.zw) * s + c01.xy;
+        gl_Position = MVP * vec4(p, 0.0, 1.0);
+    }
+)";
+
+
+// Draws the cars of a GondolaFleet with instancing: every instance is the
+// shared mesh rotated and moved by its per-instance attributes.
+const char* instancedVertexSource = R"(
+    #version 330
+    layout(location = 0) in vec2 cP;
+    layout(location = 1) in vec3 instance; // position and rotation
+    layout(location = 2) in vec4 instanceColor;
+    layout(std140) uniform View { mat4 MVP; }; // ViewBlock
+    uniform vec3 color;
+    uniform int useInstanceColor;
+    out vec3 vertexColor;
+    void main() {
+        float c = cos(instance.z), s = sin(instance.z);
+        vec2 p = mat2(c, s, -s, c) * cP + instance.xy;
+        vertexColor = useInstanceColor != 0 ? instanceColor.rgb : color;
+        gl_Position = MVP * vec4(p, 0.0, 1.0);
+    }
+)";
+
+
+// Steps the cars of a GondolaFleet in GPU physics mode with the physics of
+// GondolaFleet::animateRange, see GondolaFleet::setGPUPhysics. The spline
+// has uniform knots, so segment i spans t in [i, i + 1]. Distances, spline
+// parameters and the arc length table are double, like on the CPU.
+const char* fleetComputeSource = R"(
+    #version 430
+    struct Car { // GPUCar
+        double progress, distance;
+        float velocity, rotation;
+        vec2 position, previousPosition;
+        float previousRotation;
+        uint state, color;
+        float energy;
+    };
+    layout(local_size_x = 64) in;
+    layout(std430, binding = 0) buffer Cars { Car cars[]; };
+    layout(std430, binding = 1) readonly buffer Segments { vec2 c[]; };
+    layout(std430, binding = 2) readonly buffer ArcLengths { double s[]; };
+    layout(std430, binding = 3) buffer Counters { uint started, fallen; };
+    uniform int carCount, segmentCount, arcLengthCount, subdivisions;
+    uniform float dt, radius, gravity, epsilon;
+    const uint WAITING = 0u, STARTED = 1u, FALLEN = 2u;
+
+    vec2 derivative(int i, float u) {
+        return (c[4 * i + 3] * (3.0 * u) + c[4 * i + 2] * 2.0) * u +
+               c[4 * i + 1];
+    }
+
+    // Gauss-Legendre quadrature of the speed, as on the CPU
+    float arcLength(int i, float u0, float u1) {
+        const float nodes[5] = float[](0.0, -0.5384693101, 0.5384693101,
+                                       -0.9061798459, 0.9061798459);
+        const float weights[5] = float[](0.5688888889, 0.4786286705,
+                                         0.4786286705, 0.2369268851,
+                                         0.2369268851);
+        float halfWidth = 0.5 * (u1 - u0), mid = 0.5 * (u1 + u0), sum = 0.0;
+        for (int k = 0; k < 5; k++)
+            sum += weights[k] *
+                   length(derivative(i, mid + halfWidth * nodes[k]));
+        return sum * halfWidth;
+    }
+
+    // Spline::sToT: the table interval, then safeguarded Newton steps
+    double sToT(double x) {
+        if (segmentCount < 1 || x <= 0.0lf)
+            return 0.0lf;
+        if (x >= s[arcLengthCount - 1])
+            return double(segmentCount);
+        int lo = 0, hi = arcLengthCount - 1;
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (s[mid] <= x) lo = mid; else hi = mid;
+        }
+        int j = lo, i = j / subdivisions;
+        float h = 1.0 / float(subdivisions);
+        float pieceLength = float(s[j + 1] - s[j]);
+        float target = float(x - s[j]);
+        float a = h * float(j - i * subdivisions), b = a + h;
+        if (pieceLength <= 0.0)
+            return double(i) + double(a);
+        float start = a, u = a + h * target / pieceLength;
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float error = arcLength(i, start, u) - target;
+            if (abs(error) <= 1e-6 * pieceLength)
+                break;
+            if (error > 0.0) b = u; else a = u;
+            float speed = length(derivative(i, u));
+            float next = speed > 0.0 ? u - error / speed : a - 1.0;
+            u = (next > a && next < b) ? next : 0.5 * (a + b);
+        }
+        return double(i) + double(u);
+    }
+
+    void main() {
+        int index = int(gl_GlobalInvocationID.x);
+        if (index >= carCount)
+            return;
+        Car car = cars[index];
+        car.previousPosition = car.position;
+        car.previousRotation = car.rotation;
+        if (car.state == STARTED) {
+            int i = clamp(int(floor(car.progress)), 0, segmentCount - 1);
+            float u = float(car.progress - double(i));
+            vec2 p = ((c[4 * i + 3] * u + c[4 * i + 2]) * u + c[4 * i + 1]) *
+                     u + c[4 * i];
+            vec2 d = derivative(i, u);
+            vec2 dd = c[4 * i + 3] * (6.0 * u) + c[4 * i + 2] * 2.0;
+
+            // A broken state would otherwise keep the car started forever
+            float tangentLength = length(d);
+            if (isnan(tangentLength) || isinf(tangentLength)) {
+                car.state = FALLEN;
+            } else if (tangentLength >= epsilon) {
+                vec2 normal = vec2(-d.y, d.x) / tangentLength;
+                // A negative or NaN kinetic energy stalls the car
+                float kinetic = car.energy - gravity * p.y;
+                bool stall = !(kinetic > 0.0);
+                float v = sqrt(max(kinetic, 0.0));
+                float curvature = (d.x * dd.y - d.y * dd.x) /
+                    (tangentLength * tangentLength * tangentLength);
+                float totalForce = curvature * v * v + gravity * normal.y;
+                car.velocity = v;
+                if (stall || totalForce < 0.0) {
+                    car.state = FALLEN;
+                } else {
+                    car.distance += double(v * dt);
+                    car.position = p + normal * radius;
+                    car.rotation -= (v / radius) * dt;
+                    car.progress = sToT(car.distance);
+                    if (car.distance > s[arcLengthCount - 1] ||
+                        isnan(car.distance) || isinf(car.distance))
+                        car.state = FALLEN;
+                }
+            }
+            if (car.state == FALLEN)
+                atomicAdd(fallen, 1u);
+            else
+                atomicAdd(started, 1u);
+        }
+        cars[index] = car;
+    }
+)";
+
+
+// Draws the cars of a GondolaFleet in GPU physics mode straight from its
+// storage buffer, interpolated like GondolaFleet::draw. Waiting cars are
+// moved out of the clip volume.
+const char* fleetVertexSource = R"(
+    #version 430
+    struct Car { // GPUCar
+        double progress, distance;
+        float velocity, rotation;
+        vec2 position, previousPosition;
+        float previousRotation;
+        uint state, color;
+        float energy;
+    };
+    layout(location = 0) in vec2 cP;
+    layout(std430, binding = 0) readonly buffer Cars { Car cars[]; };
+    layout(std140) uniform View { mat4 MVP; }; // ViewBlock
+    uniform vec3 color;
+    uniform int useInstanceColor;
+    uniform float alpha;
+    out vec3 vertexColor;
+    void main() {
+        Car car = cars[gl_InstanceID];
+        if (car.state == 0u) {
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+            vertexColor = vec3(0.0);
+            return;
+        }
+        float a = car.state == 1u ? alpha : 1.0;
+        float angle = mix(car.previousRotation, car.rotation, a);
+        float c = cos(angle), s = sin(angle);
+        vec2 p = mat2(c, s, -s, c) * cP +
+                 mix(car.previousPosition, car.position, a);
+        vertexColor =
+            useInstanceColor != 0 ? unpackUnorm4x8(car.color).rgb : color;
+        gl_Position = MVP * vec4(p, 0.0, 1.0);
+    }
+)";
+
+
+// Tiles the background texture over the world behind the scene: a triangle
+// covering the viewport, whose world coordinates follow from the inverse of
+// the MVP of the view, see MyApp::drawBackground
+const char* backgroundVertexSource = R"(
+    #version 330
+    layout(std140) uniform View { mat4 MVP; }; // ViewBlock
+    uniform float tileSize;
+    out vec2 texCoord;
+    void main() {
+        vec2 clip = vec2(gl_VertexID == 1 ? 3.0 : -1.0,
+                         gl_VertexID == 2 ? 3.0 : -1.0);
+        texCoord = (inverse(MVP) * vec4(clip, 0.0, 1.0)).xy / tileSize;
+        gl_Position = vec4(clip, 0.0, 1.0);
+    }
+)";
+
+
+const char* backgroundFragmentSource = R"(
+    #version 330
+    uniform sampler2D background;
+    in vec2 texCoord;
+    out vec4 outColor;
+    void main() {
+        outColor = texture(background, texCoord);
+    }
+)";
+
+
+// Fragment shader of the programs with per-vertex or per-instance colors
+const char* vertexColorFragmentSource = R"(
+    #version 330
+    in vec3 vertexColor;
+    out vec4 outColor;
+    void main() {
+        outColor = vec4(vertexColor, 1.0);
+    }
+)";
+
+
 const char* fragmentSource = R"(
     #version 330
     uniform vec3 color;
@@ -31,14 +300,60 @@ const char* fragmentSource = R"(
  * Inherits from glApp to provide functionality for OpenGL-based rendering,
  * event handling, and animation. This class integrates a camera for world-space
  * interaction, a spline for defining a path, and a gondola for movement along
- * the spline.
+ * the spline. The scene is drawn through an overview camera and, on demand,
+ * follow-cams on the gondola and the train in insets of the window.
  */
 class MyApp final : public glApp {
 
-    Camera* camera_;
+    // Allowed distance between the curve and its tessellation, in pixels
+    static constexpr float curveTolerance_ = 0.5f;
+    // Pixels around the window kept by culling, half the control point size
+    static constexpr float cullingMargin_ = 5.0f;
+    // Pixels between the cursor and the picked control point or curve
+    static constexpr float pickingRadius_ = 8.0f;
+    // Physics runs in fixed steps, at most maxSubsteps_ of them per frame
+    static constexpr float physicsStep_ = 0.01f;
+    static constexpr int maxSubsteps_ = 25;
+    // Cars of a train and the arc length between neighbouring cars
+    static constexpr int trainCars_ = 8;
+    static constexpr float trainSpacing_ = 2.5f;
+    // Follow-cams drawn as insets along the bottom of the window: on the
+    // gondola, the front car and the last car of the train
+    static constexpr int followCams_ = 3;
+    static constexpr int insetSize_ = 160;
+    static constexpr int insetGap_ = 20;
+    static constexpr float followSize_ = 8.0f; // world units across
+    // The view of the overview camera, which edits the spline
+    static constexpr size_t overview_ = 0;
+    // Chrome trace written when profiling stops, see onKeyboard
+    static constexpr const char* profileTrace_ = "profile.json";
+    // World units covered by one tile of the background texture. The tiles
+    // divide Spline::originTile, so rebasing does not shift the pattern.
+    static constexpr float backgroundTile_ = 8.0f;
+
+    ViewSet views_{vec2(600, 600)}; // overview_ and the follow-cams
     Spline* spline_;
     Gondola* gondola_;
+    GondolaFleet* train_;
+    JobSystem jobs_;
+    BatchRenderer batch_;
     GPUProgram shader_;
+    GPUProgram lineShader_;
+    GPUProgram curveShader_;
+    GPUProgram instancedShader_;
+    GPUProgram fleetShader_;
+    GPUProgram fleetPhysicsShader_;
+    GPUProgram backgroundShader_;
+    TextureLoader textures_;
+    std::shared_ptr<AsyncTexture> background_;
+    unsigned int backgroundVao_ = 0; // attributeless, see drawBackground
+
+    // Control point or curve point under the cursor, see onMouseMotion
+    int hoveredPoint_ = -1;
+    bool curveHovered_ = false;
+    CurveHit curveHit_{};
+    // Control point moved with the mouse, -1 if none
+    int draggedPoint_ = -1;
 
   public:
     MyApp() : glApp(4, 5, 600, 600, "Gondola Spline Simulation") {}
@@ -48,44 +363,196 @@ class MyApp final : public glApp {
      * @brief Initializes resources and objects required for the application.
      *
      * This method overrides the base class onInitialization to set up the
-     * camera, spline, gondola, and shader program. The camera is initialized
-     * with a specific view range, the spline is created as the path for the
-     * gondola, and the gondola is linked to the spline. A GPUProgram is created
-     * and initialized with vertex and fragment shader source code.
+     * camera, spline, gondola, and shader program. The overview camera is
+     * initialized with a specific view range, the spline is created as the
+     * path for the gondola, and the gondola is linked to the spline. The curve
+     * tessellation tolerance is derived from the camera's pixel size. A
+     * GPUProgram is created and initialized with vertex and fragment shader
+     * source code, along with the program drawing the spline geometry, the
+     * program evaluating the curve in GPU evaluation mode and the programs
+     * stepping and drawing the train in GPU physics mode. Every drawing
+     * program reads its MVP from the View block of ViewSet. The background
+     * texture is queued on the texture loader and drawn once it is uploaded.
      */
     void onInitialization() override {
-        camera_ = new Camera(vec2(0, 0), vec2(20, 20));
+        views_.add(Camera(vec2(0, 0), vec2(20, 20)), {0, 0, 600, 600});
         spline_ = new Spline();
+        updateTolerance();
         gondola_ = new Gondola(spline_);
-        shader_.create(vertexSource, fragmentSource);
+        train_ = new GondolaFleet(spline_);
+        curveShader_.create(curveVertexSource, fragmentSource);
+        instancedShader_.create(instancedVertexSource,
+                                vertexColorFragmentSource);
+        fleetShader_.create(fleetVertexSource, vertexColorFragmentSource);
+        fleetPhysicsShader_.createCompute(fleetComputeSource);
+        shader_.create(vertexSource, vertexColorFragmentSource);
+        lineShader_.create(lineVertexSource, fragmentSource);
+        backgroundShader_.create(backgroundVertexSource,
+                                 backgroundFragmentSource);
+        for (GPUProgram* program :
+             {&shader_, &lineShader_, &curveShader_, &instancedShader_,
+              &fleetShader_, &backgroundShader_})
+            program->bindUniformBlock("View", ViewSet::viewBinding);
+        glGenVertexArrays(1, &backgroundVao_);
+        background_ = textures_.load(ASSET_DIR "background.png");
+        setFixedTimeStep(physicsStep_, maxSubsteps_);
     }
 
 
     /**
-     * @brief Renders the scene, including the spline and gondola, using the
-     * current camera view and projection.
+     * @brief Renders the scene, including the spline and gondola, through
+     * every view.
      *
-     * Clears the screen with a black background and sets up the
-     * Model-View-Projection (MVP) matrix using the camera's
-     * viewProjectionMatrix. The spline and gondola are then drawn using the
-     * shader and the computed MVP matrix.
+     * The local origin first follows the gondola or the train, see
+     * rebaseOrigin. The follow-cams are moved to their gondolas, interpolated
+     * between the last two physics states like the gondolas themselves, and the
+     * Model-View-Projection (MVP) matrices of all views are uploaded once as
+     * View blocks. Decoded textures are uploaded within the budget of the
+     * texture loader. The gondola and the marker of the control point or curve
+     * point under the cursor are queued in the batch renderer and uploaded
+     * once, like the instances of the train. Each view then clears its viewport
+     * and draws the same buffers: the background, the spline from the geometry
+     * it keeps on the GPU, or evaluated by its own program in GPU evaluation
+     * mode, culled to the segments and control points near the view, then the
+     * batch and the train. The frame is timed on the CPU and the GPU while
+     * profiling, see onKeyboard.
      */
     void onDisplay() override {
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT);
-        const mat4 MVP = camera_->viewProjectionMatrix();
-        spline_->draw(&shader_, MVP);
-        gondola_->draw(&shader_, MVP);
+        ProfileZone zone("onDisplay", true);
+        rebaseOrigin();
+        const float alpha = interpolationAlpha();
+        follow(alpha);
+        views_.upload();
+        textures_.update();
+
+        gondola_->submit(batch_, alpha);
+        if (hoveredPoint_ >= 0)
+            batch_.submit(MarkerLayer, GL_POINTS,
+                          &spline_->getControlPoints()[hoveredPoint_], 1,
+                          vec3(1, 1, 1), 14.0f);
+        else if (curveHovered_)
+            batch_.submit(MarkerLayer, GL_POINTS, &curveHit_.point, 1,
+                          vec3(1, 1, 1), 6.0f);
+        batch_.upload();
+        train_->uploadInstances(alpha);
+        GPUProgram* const trainShader =
+            train_->usesGPUPhysics() ? &fleetShader_ : &instancedShader_;
+
+        for (size_t i = 0; i < views_.size(); i++) {
+            views_.bind(i);
+            const float background = i == overview_ ? 0.0f : 0.12f;
+            glClearColor(background, background, background, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            drawBackground();
+            const WorldRect view = views_.worldRect(i, cullingMargin_);
+            spline_->drawView(&lineShader_, &view);
+            shader_.Use();
+            batch_.draw();
+            trainShader->Use();
+            train_->drawInstances(trainShader);
+        }
+        views_.unbind();
+        batch_.endDraws();
+        train_->endDraws();
     }
 
 
     /**
-     * @brief Handles mouse press events to add control points to the spline.
+     * @brief Blends the background texture over the viewport of the bound
+     * view, tiled in world space so that it moves with the camera.
+     *
+     * Nothing is drawn until the texture loader has uploaded the texture.
+     */
+    void drawBackground() {
+        if (!background_->isReady())
+            return;
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        backgroundShader_.Use();
+        background_->Bind(0);
+        backgroundShader_.setUniform(0, "background");
+        backgroundShader_.setUniform(backgroundTile_, "tileSize");
+        glBindVertexArray(backgroundVao_);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glDisable(GL_BLEND);
+    }
+
+
+    /**
+     * @brief Centers the follow-cams on their gondolas.
+     *
+     * Follow-cam k follows the gondola for k = 0 and the front or the last
+     * car of the train for k = 1, 2. A camera stays where it is while its
+     * gondola is Waiting or missing. In GPU physics mode the cars are those of
+     * the last download, see GondolaFleet::setGPUPhysics.
+     *
+     * @param alpha Interpolation factor between the previous (0) and the
+     * current (1) physics state.
+     */
+    void follow(const float alpha) {
+        for (int k = 0; k < followCams_ && overview_ + 1 + k < views_.size();
+             k++) {
+            Camera& camera = views_.getCamera(overview_ + 1 + k);
+            if (k == 0) {
+                if (gondola_->getState() != Waiting)
+                    camera.setCenter(gondola_->getPosition(alpha));
+                continue;
+            }
+            const size_t car = k == 1 ? 0 : trainCars_ - 1;
+            if (car < train_->size() && train_->getState(car) != Waiting)
+                camera.setCenter(train_->getPosition(car, alpha));
+        }
+    }
+
+
+    /**
+     * @brief Shows or hides the follow-cams.
+     *
+     * The follow-cams are insets of insetSize_ pixels along the bottom of the
+     * window, drawn over the overview.
+     */
+    void toggleFollowCams() {
+        if (views_.size() > overview_ + 1) {
+            while (views_.size() > overview_ + 1)
+                views_.remove(views_.size() - 1);
+        } else {
+            const vec2 center = views_.getCamera(overview_).getCenter();
+            for (int k = 0; k < followCams_; k++)
+                views_.add(Camera(center, vec2(followSize_, followSize_)),
+                           {insetGap_ + k * (insetSize_ + insetGap_),
+                            600 - insetGap_ - insetSize_, insetSize_,
+                            insetSize_});
+            follow(1.0f);
+        }
+        updateTolerance();
+    }
+
+
+    /**
+     * @brief Tessellates the curve finely enough for the view with the
+     * smallest pixels, so the shared geometry suits every view.
+     */
+    void updateTolerance() {
+        float pixel = views_.pixelSize(overview_);
+        for (size_t i = 0; i < views_.size(); i++)
+            pixel = fminf(pixel, views_.pixelSize(i));
+        spline_->setTolerance(curveTolerance_ * pixel);
+    }
+
+
+    /**
+     * @brief Handles mouse press events to edit the control points of the
+     * spline.
      *
      * Overrides glApp's `onMousePressed` method. If the left mouse button is
-     * pressed, the method converts the given pixel coordinates to world space
-     * using the camera and adds a new control point to the spline. The screen
-     * is refreshed to reflect updates to the spline.
+     * pressed on a control point, the point is dragged until the button is
+     * released; pressed on the curve, a new control point is inserted there
+     * and dragged. Elsewhere, the method converts the given pixel coordinates
+     * to world space using the camera and adds a new control point to the
+     * end of the spline. The right mouse button removes the control point
+     * under the cursor. The screen is refreshed to reflect updates to the
+     * spline. Only the overview edits the spline, presses on a follow-cam
+     * are ignored.
      *
      * @param button The mouse button that was pressed. Expected to be one of
      *               the values from the `MouseButton` enumeration.
@@ -94,12 +561,88 @@ class MyApp final : public glApp {
      */
     void onMousePressed(const MouseButton button, const int pX,
                         const int pY) override {
+        if (views_.viewAt(pX, pY) != static_cast<int>(overview_))
+            return;
+        const vec2 world = views_.pixelToWorld(overview_, pX, pY);
+        // An edit renumbers the control points, which ends any drag
+        draggedPoint_ = -1;
         if (button == MOUSE_LEFT) {
-            const vec2 world =
-                camera_->pixelToWorld(vec2(pX, pY), vec2(600, 600));
-            spline_->addControlPoint(world);
+            if (hoveredPoint_ >= 0) {
+                draggedPoint_ = hoveredPoint_;
+            } else if (curveHovered_) {
+                draggedPoint_ = curveHit_.segment + 1;
+                spline_->insertControlPoint(draggedPoint_, curveHit_.point);
+            } else {
+                spline_->addControlPoint(world);
+            }
+        } else if (button == MOUSE_RIGHT && hoveredPoint_ >= 0) {
+            spline_->removeControlPoint(hoveredPoint_);
+        } else {
+            return;
+        }
+        pick(world);
+        refreshScreen();
+    }
+
+
+    /**
+     * @brief Ends dragging a control point.
+     *
+     * @param button The mouse button that was released.
+     */
+    void onMouseReleased(const MouseButton button, int, int) override {
+        if (button == MOUSE_LEFT)
+            draggedPoint_ = -1;
+    }
+
+
+    /**
+     * @brief Moves the dragged control point to the cursor, or highlights the
+     * control point or curve point under it.
+     *
+     * Moving a control point only rebuilds the few segments around it, so
+     * dragging stays interactive on long tracks. A dragged point follows the
+     * cursor over the follow-cams too, but nothing is highlighted there.
+     *
+     * @param pX The x-coordinate of the mouse in window coordinates.
+     * @param pY The y-coordinate of the mouse in window coordinates.
+     */
+    void onMouseMotion(const int pX, const int pY) override {
+        const vec2 world = views_.pixelToWorld(overview_, pX, pY);
+        if (draggedPoint_ >= 0) {
+            spline_->moveControlPoint(draggedPoint_, world);
+            hoveredPoint_ = draggedPoint_;
+            curveHovered_ = false;
             refreshScreen();
+            return;
         }
+
+        const int point = hoveredPoint_;
+        const bool curve = curveHovered_;
+        const vec2 previous = curveHit_.point;
+        if (views_.viewAt(pX, pY) == static_cast<int>(overview_)) {
+            pick(world);
+        } else {
+            hoveredPoint_ = -1;
+            curveHovered_ = false;
+        }
+        if (hoveredPoint_ != point || curveHovered_ != curve ||
+            (curveHovered_ && curveHit_.point != previous))
+            refreshScreen();
+    }
+
+
+    /**
+     * @brief Finds the control point, or failing that the point of the curve,
+     * within pickingRadius_ pixels of a world position.
+     *
+     * @param world The picked position in world space.
+     */
+    void pick(const vec2 world) {
+        const float radius = pickingRadius_ * views_.pixelSize(overview_);
+        hoveredPoint_ = spline_->nearestControlPoint(world, radius);
+        curveHovered_ = hoveredPoint_ < 0 &&
+                        spline_->closestPointOnCurve(world, radius, curveHit_);
     }
 
 
@@ -109,7 +652,14 @@ class MyApp final : public glApp {
      *
      * Overrides the base class implementation for handling keyboard events.
      * When the spacebar (' ') key is pressed, this method starts the gondola's
-     * movement and refreshes the display to reflect updates.
+     * movement and refreshes the display to reflect updates. The '+' and '-'
+     * keys zoom the camera, and 'g' toggles GPU evaluation of the curve. 't'
+     * launches a train of gondolas, replacing the previous one, and 'c'
+     * moves the physics of the train to a compute shader and back. 'i'
+     * switches the integrator of the gondola from Euler to RK4 to adaptive
+     * and back. 'f' shows or hides the follow-cams. 'p' starts profiling the
+     * frames; pressed again, it prints the per-frame percentiles of every
+     * zone and writes a Chrome trace to profileTrace_.
      *
      * @param key The integer representation of the key that is pressed.
      *            For example, 32 represents the spacebar (' ').
@@ -118,27 +668,135 @@ class MyApp final : public glApp {
         if (key == ' ') {
             gondola_->start();
             refreshScreen();
+        } else if (key == '+' || key == '-') {
+            views_.getCamera(overview_).zoom(key == '+' ? 0.8f : 1.25f);
+            updateTolerance();
+            refreshScreen();
+        } else if (key == 't') {
+            startTrain();
+            refreshScreen();
+        } else if (key == 'f') {
+            toggleFollowCams();
+            refreshScreen();
+        } else if (key == 'g') {
+            spline_->setGPUEvaluation(
+                spline_->usesGPUEvaluation() ? nullptr : &curveShader_);
+            refreshScreen();
+        } else if (key == 'c') {
+            train_->setGPUPhysics(train_->usesGPUPhysics()
+                                      ? nullptr
+                                      : &fleetPhysicsShader_);
+            refreshScreen();
+        } else if (key == 'i') {
+            static const char* const names[] = {"Euler", "RK4", "adaptive"};
+            const auto integrator = static_cast<GondolaIntegrator>(
+                (gondola_->getIntegrator() + 1) % 3);
+            gondola_->setIntegrator(integrator);
+            printf("Gondola integrator: %s\n", names[integrator]);
+        } else if (key == 'p') {
+            Profiler& profiler = Profiler::get();
+            if (profiler.isEnabled()) {
+                profiler.printSummary(stdout);
+                if (profiler.writeTrace(profileTrace_))
+                    printf("Profile written to %s\n", profileTrace_);
+                profiler.setEnabled(false, false);
+            } else {
+                profiler.setEnabled(true, true);
+            }
         }
     }
 
 
     /**
-     * @brief Handles time-based animation and screen updates.
+     * @brief Advances the gondola and the train by one physics step.
      *
-     * This method is called periodically to advance the gondola's animation
-     * along the spline within the specified time interval. It processes the
-     * elapsed time in small increments and ensures the screen is refreshed
-     * after updates.
+     * The framework calls it every physicsStep_ of elapsed time, see
+     * setFixedTimeStep, with the step length itself, so every step is exactly
+     * as long however long the app runs. The screen is refreshed only while
+     * something is moving.
      *
-     * @param startTime The starting point of the time interval for this update.
-     * @param endTime The ending point of the time interval for this update.
+     * @param dt The length of the step, physicsStep_.
      */
-    void onTimeElapsed(const float startTime, const float endTime) override {
-        constexpr float dt = 0.01f;
-        for (float t = startTime; t < endTime; t += dt) {
-            const float Dt = fmin(dt, endTime - t);
-            gondola_->animate(Dt);
-        }
+    void onFixedStep(const float dt) override {
+        if (!isAnimating())
+            return;
+
+        ProfileZone zone("onFixedStep");
+        gondola_->animate(dt);
+        train_->animateAll(dt, &jobs_);
         refreshScreen();
     }
+
+
+    /**
+     * @brief Reports whether the scene is animating.
+     *
+     * Only started gondolas move; otherwise the framework can sleep until
+     * the next input event. Frames also go on while textures are loading,
+     * so that they are uploaded as soon as they are decoded.
+     *
+     * @return True while the gondola or any car of the train is moving along
+     * the spline, or a texture is loading.
+     */
+    bool isAnimating() const override {
+        return gondola_->getState() == Started ||
+               train_->startedCount() > 0 || textures_.loadingCount() > 0;
+    }
+
+
+    /**
+     * @brief Keeps the scene coordinates small around what moves.
+     *
+     * The focus is the gondola while it moves, otherwise the first moving
+     * car of the train. Once it is more than Spline::rebaseDistance from the
+     * local origin, the origin jumps to the whole tile nearest to it and the
+     * spline, every camera, the gondola and the train are moved by the same
+     * offset, see Spline::rebaseOffset, so the floats of rendering and
+     * physics stay small around the focus on tracks of any length. While
+     * nothing moves the origin stays where it is.
+     */
+    void rebaseOrigin() {
+        vec2 offset(0, 0);
+        if (gondola_->getState() == Started) {
+            offset = Spline::rebaseOffset(gondola_->getPosition());
+        } else if (train_->startedCount() > 0) {
+            for (size_t i = 0; i < train_->size(); i++) {
+                if (train_->getState(i) == Started) {
+                    offset = Spline::rebaseOffset(train_->getPosition(i));
+                    break;
+                }
+            }
+        }
+        if (offset == vec2(0, 0))
+            return;
+        spline_->rebase(offset);
+        for (size_t i = 0; i < views_.size(); i++) {
+            Camera& camera = views_.getCamera(i);
+            camera.setCenter(camera.getCenter() - offset);
+        }
+        gondola_->rebase(offset);
+        train_->rebase(offset);
+        curveHit_.point -= offset;
+    }
+
+
+    /**
+     * @brief Launches a new train of gondolas.
+     *
+     * The cars are placed trainSpacing_ apart in arc length from the start of
+     * the spline and then move independently, each following the physics
+     * of a single gondola. The cars are shaded from blue to green.
+     */
+    void startTrain() {
+        train_->resize(0);
+        train_->resize(trainCars_);
+        const double first = spline_->tToS(0.01);
+        for (int i = 0; i < trainCars_; i++) {
+            const int carsAhead = trainCars_ - 1 - i;
+            train_->startAt(i, first + carsAhead * trainSpacing_);
+            const float shade = static_cast<float>(i) / (trainCars_ - 1);
+            train_->setColor(i, mix(vec3(0.2f, 0.4f, 1.0f),
+                                    vec3(0.2f, 0.8f, 0.4f), shade));
+        }
+    }
 } app;
@@ -0,0 +1,218 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+
+
+/**
+ * @brief Constructs an empty grid.
+ *
+ * @param cellSize The side length of the cells in world units.
+ */
+SpatialGrid::SpatialGrid(const float cellSize) : cellSize_(cellSize) {}
+
+
+/**
+ * @param x A world coordinate.
+ * @return The index of the cell column or row containing x.
+ */
+int SpatialGrid::cellOf(const float x) const {
+    return static_cast<int>(floorf(x / cellSize_));
+}
+
+
+/**
+ * @return The hash map key of cell (x, y).
+ */
+uint64_t SpatialGrid::key(const int x, const int y) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 |
+           static_cast<uint32_t>(y);
+}
+
+
+/**
+ * @return The larger side of a box.
+ */
+float SpatialGrid::extentOf(const WorldRect& box) {
+    return std::max(box.max.x - box.min.x, box.max.y - box.min.y);
+}
+
+
+/**
+ * @brief Lists a handle in every cell its box overlaps.
+ *
+ * @param handle The handle of the item.
+ */
+void SpatialGrid::link(const int handle) {
+    const WorldRect& box = boxes_[handle];
+    for (int y = cellOf(box.min.y); y <= cellOf(box.max.y); y++)
+        for (int x = cellOf(box.min.x); x <= cellOf(box.max.x); x++)
+            cells_[key(x, y)].push_back(handle);
+}
+
+
+/**
+ * @brief Adds an item to every cell its box overlaps.
+ *
+ * An item already listed with the id is replaced.
+ *
+ * @param id The id of the item, not negative.
+ * @param box The bounding box of the item.
+ */
+void SpatialGrid::insert(const int id, const WorldRect& box) {
+    if (id < static_cast<int>(handles_.size()))
+        remove(id);
+    else
+        handles_.resize(id + 1, -1);
+
+    int handle;
+    if (freeHandles_.empty()) {
+        handle = static_cast<int>(ids_.size());
+        ids_.push_back(id);
+        boxes_.push_back(box);
+    } else {
+        handle = freeHandles_.back();
+        freeHandles_.pop_back();
+        ids_[handle] = id;
+        boxes_[handle] = box;
+    }
+    handles_[id] = handle;
+    link(handle);
+    extentSum_ += extentOf(box);
+    itemCount_++;
+}
+
+
+/**
+ * @brief Removes an item from the cells of the box it was inserted with.
+ *
+ * Ids that are not listed are ignored.
+ *
+ * @param id The id of the item.
+ */
+void SpatialGrid::remove(const int id) {
+    if (id < 0 || id >= static_cast<int>(handles_.size()) ||
+        handles_[id] < 0)
+        return;
+    const int handle = handles_[id];
+    const WorldRect& box = boxes_[handle];
+    for (int y = cellOf(box.min.y); y <= cellOf(box.max.y); y++) {
+        for (int x = cellOf(box.min.x); x <= cellOf(box.max.x); x++) {
+            const auto cell = cells_.find(key(x, y));
+            if (cell == cells_.end())
+                continue;
+            std::vector<int>& handles = cell->second;
+            const auto it = std::find(handles.begin(), handles.end(), handle);
+            if (it != handles.end()) {
+                *it = handles.back();
+                handles.pop_back();
+            }
+            if (handles.empty())
+                cells_.erase(cell);
+        }
+    }
+    extentSum_ -= extentOf(box);
+    itemCount_--;
+    handles_[id] = -1;
+    ids_[handle] = -1;
+    freeHandles_.push_back(handle);
+}
+
+
+/**
+ * @brief Shifts the ids from first on.
+ *
+ * Every id of at least first is changed by delta. A positive delta opens
+ * delta unlisted ids at first, e.g. renumber(i, 1) before inserting a new
+ * item i; a negative one closes ids that must not be listed, e.g.
+ * renumber(i + 1, -1) after removing item i. The cells are not visited: only
+ * the handles of the shifted ids learn their new ids.
+ *
+ * @param first The smallest id that is shifted.
+ * @param delta The change of the shifted ids.
+ */
+void SpatialGrid::renumber(const int first, const int delta) {
+    if (delta == 0 || first >= static_cast<int>(handles_.size()))
+        return;
+    if (delta > 0)
+        handles_.insert(handles_.begin() + first, delta, -1);
+    else
+        handles_.erase(handles_.begin() + first + delta,
+                       handles_.begin() + first);
+    for (int id = first + std::min(delta, 0);
+         id < static_cast<int>(handles_.size()); id++)
+        if (handles_[id] >= 0)
+            ids_[handles_[id]] = id;
+}
+
+
+/**
+ * @brief Removes every item.
+ */
+void SpatialGrid::clear() {
+    cells_.clear();
+    handles_.clear();
+    ids_.clear();
+    boxes_.clear();
+    freeHandles_.clear();
+    extentSum_ = 0.0;
+    itemCount_ = 0;
+}
+
+
+/**
+ * @brief Collects the items listed in the cells a box overlaps.
+ *
+ * The result is a superset of the items whose boxes overlap the query box;
+ * callers test the candidates exactly.
+ *
+ * @param box The query box.
+ * @param ids Receives the ids of the candidates, sorted and without
+ * duplicates. Its capacity is reused, so callers keeping the vector between
+ * queries do not allocate.
+ */
+void SpatialGrid::query(const WorldRect& box, std::vector<int>& ids) const {
+    ids.clear();
+    for (int y = cellOf(box.min.y); y <= cellOf(box.max.y); y++) {
+        for (int x = cellOf(box.min.x); x <= cellOf(box.max.x); x++) {
+            const auto cell = cells_.find(key(x, y));
+            if (cell == cells_.end())
+                continue;
+            for (const int handle : cell->second)
+                ids.push_back(ids_[handle]);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+
+/**
+ * @return The mean of the larger sides of the listed boxes, 0 for an empty
+ * grid.
+ */
+float SpatialGrid::meanExtent() const {
+    return itemCount_ == 0 ? 0.0f
+                           : static_cast<float>(extentSum_ / itemCount_);
+}
+
+
+/**
+ * @brief Changes the cell size and lists every item again.
+ *
+ * @param cellSize The new side length of the cells in world units.
+ */
+void SpatialGrid::setCellSize(const float cellSize) {
+    if (cellSize == cellSize_)
+        return;
+    cellSize_ = cellSize;
+    cells_.clear();
+    for (int handle = 0; handle < static_cast<int>(ids_.size()); handle++)
+        if (ids_[handle] >= 0)
+            link(handle);
+}
+
+
+/**
+ * @return The side length of the cells in world units.
+ */
+float SpatialGrid::getCellSize() const { return cellSize_; }
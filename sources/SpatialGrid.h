@@ -0,0 +1,65 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include "Camera.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * @class SpatialGrid
+ * @brief Uniform grid of square cells indexing items by their bounding boxes.
+ *
+ * An item is listed in every cell its box overlaps. Only the non-empty cells
+ * are stored, in a hash map, so the grid is unbounded and its memory follows
+ * the number of items. Items are identified by small integer ids chosen by
+ * the caller, like array indices, and are updated by inserting them again
+ * with a new box or removing them by id. The cells list stable handles
+ * instead of the ids, so when the caller's ids shift, e.g. because an item
+ * was inserted into the middle of an array, renumber only shifts the table
+ * from ids to handles and visits no cell. The cell size can be changed at
+ * any time, see setCellSize and meanExtent.
+ */
+class SpatialGrid {
+
+    float cellSize_;
+    std::unordered_map<uint64_t, std::vector<int>> cells_; // of handles
+    std::vector<int> handles_;     // by id, -1 for ids not listed
+    std::vector<int> ids_;         // by handle, -1 for free handles
+    std::vector<WorldRect> boxes_; // by handle
+    std::vector<int> freeHandles_;
+    double extentSum_ = 0.0; // of the listed boxes
+    size_t itemCount_ = 0;
+
+    int cellOf(float x) const;
+
+    static uint64_t key(int x, int y);
+
+    static float extentOf(const WorldRect& box);
+
+    void link(int handle);
+
+  public:
+    explicit SpatialGrid(float cellSize);
+
+    void insert(int id, const WorldRect& box);
+
+    void remove(int id);
+
+    void renumber(int first, int delta);
+
+    void clear();
+
+    void query(const WorldRect& box, std::vector<int>& ids) const;
+
+    float meanExtent() const;
+
+    void setCellSize(float cellSize);
+
+    float getCellSize() const;
+};
+
+
+#endif // SPATIALGRID_H
@@ -1,5 +1,46 @@
 #include "Spline.h"
 
+#include <algorithm>
+#include <limits>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#    include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
+
+/**
+ * Computes the power-basis coefficients of a Hermite curve segment.
+ *
+ * The coefficients are expressed in the local parameter u = t - t0, so the
+ * segment can later be evaluated without any divisions.
+ *
+ * @param p0 The starting position of the Hermite curve segment.
+ * @param v0 The starting tangent vector at p0.
+ * @param t0 The parameter value corresponding to the starting point p0.
+ * @param p1 The ending position of the Hermite curve segment.
+ * @param v1 The ending tangent vector at p1.
+ * @param t1 The parameter value corresponding to the ending point p1.
+ *
+ * @return The cubic coefficients a0..a3 of the segment.
+ */
+CubicSegment HermiteCoefficients(const vec2& p0, const vec2& v0,
+                                 const float t0, const vec2& p1,
+                                 const vec2& v1, const float t1) {
+    const float dt = t1 - t0;
+    const float invDt = 1.0f / dt;
+    const float invDt2 = invDt * invDt;
+    CubicSegment c;
+    c.a0 = p0;
+    c.a1 = v0;
+    c.a2 = (p1 - p0) * 3.0f * invDt2 - (v1 + 2.0f * v0) * invDt;
+    c.a3 = (p0 - p1) * 2.0f * invDt2 * invDt + (v1 + v0) * invDt2;
+    return c;
+}
+
 
 /**
  * Computes a Hermite spline interpolation for a given parameter t.
@@ -16,14 +57,325 @@
  */
 vec2 Hermite(const vec2& p0, const vec2& v0, const float t0, const vec2& p1,
              const vec2& v1, const float t1, const float t) {
-    const float s = (t - t0) / (t1 - t0);
-    const vec2 a0 = p0;
-    const vec2 a1 = v0;
-    const vec2 a2 =
-        (p1 - p0) * 3.0f / (t1 - t0) / (t1 - t0) - (v1 + 2.0f * v0) / (t1 - t0);
-    const vec2 a3 = (p0 - p1) * 2.0f / powf(t1 - t0, 3.0f) +
-                    (v1 + v0) / powf(t1 - t0, 2.0f);
-    return ((a3 * s + a2) * s + a1) * s + a0;
+    return HermiteCoefficients(p0, v0, t0, p1, v1, t1).point(t - t0);
+}
+
+
+/**
+ * Locates the interval [keys[i], keys[i + 1]] of a sorted array containing x.
+ *
+ * If a hint is given, the interval it points to and the one after it are tried
+ * first, which makes monotonic queries amortized O(1). Otherwise, or if the
+ * hint misses, the interval is found with a binary search. The hint is updated
+ * to the located interval.
+ *
+ * @param keys The sorted keys, at least two of them.
+ * @param x The value to locate.
+ * @param hint Optional cursor holding the last interval found by the caller.
+ *
+ * @return The index of the interval, or -1 if x is out of range.
+ */
+template <typename Key>
+static int locateInterval(const std::vector<Key>& keys, const double x,
+                          int* hint) {
+    const int intervals = static_cast<int>(keys.size()) - 1;
+    if (intervals < 1 || x < keys.front() || x > keys.back())
+        return -1;
+
+    if (hint != nullptr && *hint >= 0) {
+        for (int i = *hint; i < intervals && i <= *hint + 1; i++) {
+            if (keys[i] <= x && x <= keys[i + 1]) {
+                *hint = i;
+                return i;
+            }
+        }
+    }
+
+    const auto it = std::upper_bound(keys.begin(), keys.end(), x);
+    const int i =
+        std::min(static_cast<int>(it - keys.begin()) - 1, intervals - 1);
+    if (hint != nullptr)
+        *hint = i;
+    return i;
+}
+
+
+/**
+ * Computes the arc length of a cubic segment between the local parameters u0
+ * and u1.
+ *
+ * The speed |p'(u)| is integrated with 5-point Gauss-Legendre quadrature. The
+ * speed has a kink where the curve has a cusp, so callers keep the interval
+ * short (see arcLengthSubdivisions) to stay accurate there.
+ *
+ * @param c The coefficients of the segment.
+ * @param u0 The local parameter where the measurement starts.
+ * @param u1 The local parameter where the measurement ends.
+ *
+ * @return The arc length of the segment over [u0, u1].
+ */
+static float arcLength(const CubicSegment& c, const float u0, const float u1) {
+    constexpr float nodes[5] = {0.0f, -0.5384693101f, 0.5384693101f,
+                                -0.9061798459f, 0.9061798459f};
+    constexpr float weights[5] = {0.5688888889f, 0.4786286705f, 0.4786286705f,
+                                  0.2369268851f, 0.2369268851f};
+    const float half = 0.5f * (u1 - u0);
+    const float mid = 0.5f * (u1 + u0);
+    float sum = 0.0f;
+    for (int k = 0; k < 5; k++)
+        sum += weights[k] * length(c.derivative(mid + half * nodes[k]));
+    return sum * half;
+}
+
+
+/**
+ * Bounds a segment by the control hull of its Bezier form.
+ *
+ * The curve lies in the convex hull of its Bezier control points, which are
+ * derived from the end points and end derivatives, so the box of the four
+ * points bounds the whole segment.
+ *
+ * @param c The coefficients of the segment.
+ * @param h The parameter length of the segment.
+ * @return The axis-aligned box of the control hull.
+ */
+static WorldRect hullBounds(const CubicSegment& c, const float h) {
+    const vec2 b0 = c.point(0.0f);
+    const vec2 b3 = c.point(h);
+    const vec2 b1 = b0 + c.derivative(0.0f) * (h / 3.0f);
+    const vec2 b2 = b3 - c.derivative(h) * (h / 3.0f);
+    return {min(min(b0, b1), min(b2, b3)), max(max(b0, b1), max(b2, b3))};
+}
+
+
+/**
+ * Creates an empty spline.
+ *
+ * A spline that is not renderable keeps no vertices and makes no GL calls, so
+ * it can be built and evaluated without a GL context, e.g. by the headless
+ * simulation. It must not be drawn.
+ *
+ * @param renderable False to skip the tessellation and every GPU upload.
+ */
+Spline::Spline(const bool renderable) : renderable_(renderable) {}
+
+
+/**
+ * Releases the vertex array used by the GPU evaluation mode.
+ */
+Spline::~Spline() {
+    if (curveVao_ > 0)
+        glDeleteVertexArrays(1, &curveVao_);
+}
+
+
+/**
+ * Computes the Catmull-Rom tangent at the control point with index i.
+ *
+ * The tangent is the central difference of the neighbouring control points,
+ * taken in world coordinates. The first and the last control points have
+ * zero tangents.
+ *
+ * @param i The index of the control point.
+ * @return The tangent vector at the control point.
+ */
+dvec2 Spline::tangent(const int i) const {
+    if (i <= 0 || i >= static_cast<int>(cps_.size()) - 1)
+        return dvec2(0, 0);
+    return (worldCps_[i + 1] - worldCps_[i - 1]) /
+           (static_cast<double>(ts_[i + 1]) - ts_[i - 1]);
+}
+
+
+/**
+ * Computes the coefficients of segment i, see HermiteCoefficients.
+ *
+ * They are computed in double from the world control points and only then
+ * rounded to float, with a0 taken relative to the origin. The differences
+ * of the world positions lose nothing however far the segment lies from the
+ * origin, so a1..a3 are the same for every origin and rebase only changes a0.
+ *
+ * @param i The index of the segment.
+ * @return The cubic coefficients of the segment in local coordinates.
+ */
+CubicSegment Spline::localSegment(const int i) const {
+    const dvec2 p0 = worldCps_[i], p1 = worldCps_[i + 1];
+    const dvec2 v0 = tangent(i), v1 = tangent(i + 1);
+    const double invDt = 1.0 / (static_cast<double>(ts_[i + 1]) - ts_[i]);
+    const double invDt2 = invDt * invDt;
+    CubicSegment c;
+    c.a0 = cps_[i];
+    c.a1 = vec2(v0);
+    c.a2 = vec2((p1 - p0) * (3.0 * invDt2) - (v1 + 2.0 * v0) * invDt);
+    c.a3 = vec2((p0 - p1) * (2.0 * invDt2 * invDt) + (v1 + v0) * invDt2);
+    return c;
+}
+
+
+/**
+ * Recomputes the cached cubic coefficients of the segments first..last.
+ *
+ * The cache is resized to hold one entry per segment, so it always matches the
+ * current number of control points. The cumulative arc length table, which
+ * holds arcLengthSubdivisions entries per segment, is integrated again over
+ * the rebuilt segments only; the entries after them are shifted by the change
+ * of length. The bounds of the rebuilt segments, of their blocks and their
+ * entries in the picking grid, if it is built, are refreshed with them, and
+ * the grid cells follow the mean segment size, see fitPickingCells.
+ *
+ * @param first The index of the first segment to rebuild.
+ * @param last The index of the last segment to rebuild (inclusive).
+ */
+void Spline::rebuildSegments(const int first, const int last) {
+    revision_++;
+    segments_.resize(cps_.size() < 2 ? 0 : cps_.size() - 1);
+    const int begin = std::max(first, 0);
+    const int end = std::min(last, static_cast<int>(segments_.size()) - 1);
+    for (int i = begin; i <= end; i++)
+        segments_[i] = localSegment(i);
+
+    segmentBounds_.resize(segments_.size());
+    for (int i = begin; i <= end; i++) {
+        segmentBounds_[i] = hullBounds(segments_[i], ts_[i + 1] - ts_[i]);
+        if (pickingIndexed_)
+            segmentGrid_.insert(i, segmentBounds_[i]);
+    }
+    if (pickingIndexed_)
+        fitPickingCells();
+    updateBlockBounds(begin, end);
+
+    constexpr int n = arcLengthSubdivisions;
+    const size_t oldEntries = arcLengths_.size();
+    arcLengths_.resize(segments_.size() * n + 1);
+    arcLengths_[0] = 0.0;
+    const size_t tail = static_cast<size_t>(end + 1) * n;
+    const double oldTail = tail < oldEntries ? arcLengths_[tail] : 0.0;
+    for (int i = begin; i <= end; i++) {
+        const float h = (ts_[i + 1] - ts_[i]) / n;
+        for (int k = 0; k < n; k++)
+            arcLengths_[i * n + k + 1] =
+                arcLengths_[i * n + k] +
+                arcLength(segments_[i], h * k, h * (k + 1));
+    }
+    if (tail < oldEntries) {
+        const double delta = arcLengths_[tail] - oldTail;
+        for (size_t k = tail + 1; k < arcLengths_.size(); k++)
+            arcLengths_[k] += delta;
+    }
+}
+
+
+/**
+ * Recomputes the culling bounds of the blocks holding the segments
+ * firstSegment..lastSegment and of their ancestors in the bounds tree.
+ *
+ * A leaf bounds one block of boundsBlockSize segments and every inner node
+ * the union of its children. Leaves without a block are empty, an inverted
+ * box overlapping nothing. Only the changed leaves and the paths above them
+ * are refreshed; the tree is rebuilt when the number of leaves, a power of
+ * two, changes.
+ *
+ * @param firstSegment The index of the first changed segment.
+ * @param lastSegment The index of the last changed segment (inclusive).
+ */
+void Spline::updateBlockBounds(const int firstSegment, const int lastSegment) {
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+    const WorldRect empty{vec2(infinity, infinity), vec2(-infinity, -infinity)};
+    const int segmentCount = static_cast<int>(segments_.size());
+    const int blockCount =
+        (segmentCount + boundsBlockSize - 1) / boundsBlockSize;
+    int leaves = 1;
+    while (leaves < blockCount)
+        leaves *= 2;
+
+    int first = std::max(firstSegment, 0) / boundsBlockSize;
+    int last = std::min(lastSegment / boundsBlockSize, blockCount - 1);
+    if (leaves != boundsLeaves_) {
+        boundsLeaves_ = leaves;
+        boundsTree_.assign(2 * static_cast<size_t>(leaves), empty);
+        first = 0;
+        last = blockCount - 1;
+    } else if (blockCount < boundsBlocks_) {
+        last = boundsBlocks_ - 1; // the dropped blocks become empty
+    }
+    boundsBlocks_ = blockCount;
+    if (first > last)
+        return;
+
+    for (int b = first; b <= last; b++) {
+        WorldRect bounds = empty;
+        const int begin = b * boundsBlockSize;
+        const int stop = std::min(begin + boundsBlockSize, segmentCount);
+        for (int i = begin; i < stop; i++) {
+            bounds.min = min(bounds.min, segmentBounds_[i].min);
+            bounds.max = max(bounds.max, segmentBounds_[i].max);
+        }
+        boundsTree_[leaves + b] = bounds;
+    }
+    for (int lo = (leaves + first) / 2, hi = (leaves + last) / 2; lo >= 1;
+         lo /= 2, hi /= 2) {
+        for (int k = lo; k <= hi; k++)
+            boundsTree_[k] = {min(boundsTree_[2 * k].min,
+                                  boundsTree_[2 * k + 1].min),
+                              max(boundsTree_[2 * k].max,
+                                  boundsTree_[2 * k + 1].max)};
+    }
+}
+
+
+/**
+ * Builds the picking grids if they are missing.
+ *
+ * A spline filled by assign only indexes its control points and segments for
+ * picking on the first query, so loading a huge track does not pay for it.
+ * The grids are then kept up to date by every edit. The queries share a
+ * scratch buffer for the candidates, so they must not run concurrently.
+ */
+void Spline::indexForPicking() const {
+    if (pickingIndexed_)
+        return;
+    for (int i = 0; i < static_cast<int>(cps_.size()); i++)
+        pointGrid_.insert(i, {cps_[i], cps_[i]});
+    for (int i = 0; i < static_cast<int>(segmentBounds_.size()); i++)
+        segmentGrid_.insert(i, segmentBounds_[i]);
+    pickingIndexed_ = true;
+    fitPickingCells();
+}
+
+
+/**
+ * Sizes the cells of both picking grids by the mean extent of the segments.
+ *
+ * Cells about as large as a segment list each segment in a few cells and
+ * hold a few control points each, however long or short the segments are.
+ * The grids are only rebuilt when the mean has drifted to less than half or
+ * more than twice the cell size, so the rebuilds are rare during editing.
+ */
+void Spline::fitPickingCells() const {
+    const float cellSize = segmentGrid_.getCellSize();
+    const float mean =
+        std::max(segmentGrid_.meanExtent(), minPickingCellSize);
+    if (segments_.empty() || (mean >= 0.5f * cellSize && mean <= 2 * cellSize))
+        return;
+    segmentGrid_.setCellSize(mean);
+    pointGrid_.setCellSize(mean);
+}
+
+
+/**
+ * Copies the control points first..first + count - 1 to the control geometry
+ * and uploads them, after resizing it to the number of control points.
+ *
+ * @param first The index of the first changed control point.
+ * @param count The number of changed control points.
+ */
+void Spline::updateControlGeometry(const size_t first, const size_t count) {
+    if (!renderable_)
+        return;
+    std::vector<vec2>& vtx = controlGeometry_.Vtx();
+    vtx.resize(cps_.size());
+    std::copy_n(cps_.begin() + first, count, vtx.begin() + first);
+    controlGeometry_.updateGPU(first, count);
 }
 
 
@@ -31,126 +383,1492 @@ vec2 Hermite(const vec2& p0, const vec2& v0, const float t0, const vec2& p1,
  * Adds a new control point to the spline.
  * The control point will be added to the list of control points and a
  * corresponding parameter value will be generated based on the number of
- * existing points. After adding the point, the spline is updated.
+ * existing points. Like every edit it takes the point in local coordinates,
+ * relative to getOrigin(). Only the last two segments change their
+ * coefficients: the previously last one gets a non-zero end tangent and a new
+ * one is appended. The point is appended to the control geometry and only the
+ * affected tail of the curve is re-tessellated and uploaded to the GPU.
  *
  * @param cp The new control point to be added, represented as a 2D vector.
  */
 void Spline::addControlPoint(const vec2 cp) {
     const float t = cps_.empty() ? 0.0f : ts_.back() + 1.0f;
+    worldCps_.push_back(origin_ + dvec2(cp));
     cps_.push_back(cp);
     ts_.push_back(t);
+    const int last = static_cast<int>(cps_.size()) - 2;
+    rebuildSegments(last - 1, last);
+
+    if (pickingIndexed_)
+        pointGrid_.insert(last + 1, {cp, cp});
+    updateControlGeometry(cps_.size() - 1, 1);
+    tessellate(last - 1);
+}
+
+
+/**
+ * Appends control points to the spline in one batch.
+ *
+ * Equivalent to calling addControlPoint for every point, but the tables grow
+ * at most once, geometrically, the segments are rebuilt in a single pass and
+ * the geometry is re-tessellated and uploaded once, from the previously last
+ * segment on.
+ *
+ * @param points The new control points in local coordinates, in order.
+ */
+void Spline::addControlPoints(const std::span<const vec2> points) {
+    if (points.empty())
+        return;
+    const size_t first = cps_.size();
+    // Exact reservations would reallocate on every batch
+    if (first + points.size() > cps_.capacity())
+        reserve(std::max(first + points.size(), 2 * cps_.capacity()));
+    const float t0 = cps_.empty() ? 0.0f : ts_.back() + 1.0f;
+    cps_.insert(cps_.end(), points.begin(), points.end());
+    for (size_t k = 0; k < points.size(); k++) {
+        worldCps_.push_back(origin_ + dvec2(points[k]));
+        ts_.push_back(t0 + static_cast<float>(k));
+    }
+
+    // The previously last segment gets a non-zero end tangent
+    const int firstSegment = static_cast<int>(first) - 2;
+    rebuildSegments(firstSegment, static_cast<int>(cps_.size()) - 2);
+    if (pickingIndexed_)
+        for (size_t i = first; i < cps_.size(); i++)
+            pointGrid_.insert(static_cast<int>(i), {cps_[i], cps_[i]});
+    updateControlGeometry(first, points.size());
+    tessellate(firstSegment);
+}
+
+
+/**
+ * Reserves room for count control points in the tables of the spline.
+ *
+ * Loading a track of known size then grows none of the tables, see
+ * addControlPoints.
+ *
+ * @param count The expected number of control points.
+ */
+void Spline::reserve(const size_t count) {
+    const size_t segmentCount = count < 2 ? 0 : count - 1;
+    worldCps_.reserve(count);
+    cps_.reserve(count);
+    ts_.reserve(count);
+    segments_.reserve(segmentCount);
+    segmentBounds_.reserve(segmentCount);
+    arcLengths_.reserve(segmentCount * arcLengthSubdivisions + 1);
+    if (renderable_)
+        controlGeometry_.Vtx().reserve(count);
+}
+
+
+/**
+ * Replaces every control point of the spline.
+ *
+ * The arrays are copied in bulk, without per-point updates, so the cost of
+ * loading a track is a few memcpy calls and one pass rounding the points to
+ * local floats, plus the derived tables. If the segment coefficients and the
+ * arc length table are given, e.g. from a binary track file, they are taken
+ * as they are; otherwise they are computed. The bounds and the geometry are
+ * built from scratch, the picking grids only by the first query needing
+ * them.
+ *
+ * @param points The control points in world coordinates.
+ * @param knots The knots of the control points: 0, 1, 2, ... like the ones
+ * assigned by addControlPoint.
+ * @param count The number of control points.
+ * @param segments Optional coefficients of the count - 1 segments.
+ * @param arcLengths Optional cumulative arc length table of the segments,
+ * arcLengthSubdivisions entries per segment and a leading zero; only used
+ * together with segments.
+ * @param origin The world position of the new local origin, which the given
+ * segments are relative to, see rebase.
+ */
+void Spline::assign(const dvec2* points, const float* knots,
+                    const size_t count, const CubicSegment* segments,
+                    const double* arcLengths, const dvec2 origin) {
+    revision_++;
+    origin_ = origin;
+    worldCps_.assign(points, points + count);
+    cps_.resize(count);
+    for (size_t i = 0; i < count; i++)
+        cps_[i] = vec2(points[i] - origin);
+    ts_.assign(knots, knots + count);
+    pointGrid_.clear();
+    segmentGrid_.clear();
+    pickingIndexed_ = false;
+    segmentBounds_.clear();
+    const size_t segmentCount = count < 2 ? 0 : count - 1;
+    if (segments == nullptr || arcLengths == nullptr) {
+        arcLengths_.clear();
+        rebuildSegments(0, static_cast<int>(segmentCount) - 1);
+    } else {
+        segments_.assign(segments, segments + segmentCount);
+        arcLengths_.assign(arcLengths,
+                           arcLengths + segmentCount * arcLengthSubdivisions +
+                               1);
+        segmentBounds_.resize(segmentCount);
+        for (int i = 0; i < static_cast<int>(segmentCount); i++)
+            segmentBounds_[i] = hullBounds(segments_[i], ts_[i + 1] - ts_[i]);
+        updateBlockBounds(0, static_cast<int>(segmentCount) - 1);
+    }
+
     update();
 }
 
 
 /**
- * Evaluates the spline at the specified parameter t and returns the
- * corresponding point on the curve.
+ * Moves the control point with index i.
  *
- * This function computes the interpolation using a Hermite spline between
- * control points that bound the parameter t. If the parameter t is outside the
- * range of the spline, it returns either the first or the last control point.
+ * A Catmull-Rom control point only influences the segments i - 2..i + 1:
+ * two through its position and two more through the tangents of its
+ * neighbours. Only those segments are rebuilt, re-tessellated and uploaded,
+ * so dragging a point costs the same on any length of track.
  *
- * @param t The parameter value at which to evaluate the spline. It is expected
- * to be within the range defined by the time values of the spline control
- * points.
+ * @param i The index of the control point.
+ * @param cp The new position of the control point.
+ */
+void Spline::moveControlPoint(const int i, const vec2 cp) {
+    if (i < 0 || i >= static_cast<int>(cps_.size()))
+        return;
+    if (pickingIndexed_) {
+        pointGrid_.insert(i, {cp, cp});
+    }
+    worldCps_[i] = origin_ + dvec2(cp);
+    cps_[i] = cp;
+    rebuildSegments(i - 2, i + 1);
+
+    updateControlGeometry(i, 1);
+    retessellate(i - 2, i + 1);
+}
+
+
+/**
+ * Inserts a control point before the control point with index i.
  *
- * @return A vec2 representing the point on the spline at the specified
- * parameter t. If the spline contains fewer than two control points, returns
- * vec2(0, 0).
+ * The knots stay uniform, so the segments after the new point keep their
+ * coefficients and only move one place; the segments i - 2..i + 1 around it
+ * are rebuilt. The ids of the following control points and segments are
+ * shifted in the picking grids, and the block bounds after the point are
+ * recomputed.
+ *
+ * @param i The index of the new control point; the size of the spline
+ * appends it like addControlPoint.
+ * @param cp The new control point.
  */
-vec2 Spline::evaluate(const float t) const {
-    if (cps_.size() < 2)
-        return vec2(0, 0);
+void Spline::insertControlPoint(const int i, const vec2 cp) {
+    const int size = static_cast<int>(cps_.size());
+    if (i < 0 || i > size)
+        return;
+    if (i == size) {
+        addControlPoint(cp);
+        return;
+    }
 
-    for (int i = 0; i < static_cast<int>(cps_.size()) - 1; i++) {
-        if (ts_[i] <= t && t <= ts_[i + 1]) {
-            vec2 v0(0, 0), v1(0, 0);
-            if (i > 0)
-                v0 = (cps_[i + 1] - cps_[i - 1]) / (ts_[i + 1] - ts_[i - 1]);
-            if (i < static_cast<int>(cps_.size()) - 2)
-                v1 = (cps_[i + 2] - cps_[i]) / (ts_[i + 2] - ts_[i]);
-            return Hermite(cps_[i], v0, ts_[i], cps_[i + 1], v1, ts_[i + 1], t);
-        }
+    worldCps_.insert(worldCps_.begin() + i, origin_ + dvec2(cp));
+    cps_.insert(cps_.begin() + i, cp);
+    ts_.push_back(ts_.back() + 1.0f);
+    if (pickingIndexed_) {
+        pointGrid_.renumber(i, 1);
+        pointGrid_.insert(i, {cp, cp});
+    }
+    updateControlGeometry(i, cps_.size() - i);
+    if (cps_.size() < 3) {
+        rebuildSegments(0, 0);
+        tessellate(0);
+        return;
+    }
+
+    // The new segment i starts empty and is filled by the rebuild, the
+    // cumulative arc lengths of the following segments are shifted there
+    constexpr int n = arcLengthSubdivisions;
+    const float start = arcLengths_[i * n];
+    segments_.insert(segments_.begin() + i, CubicSegment{});
+    segmentBounds_.insert(segmentBounds_.begin() + i, WorldRect{cp, cp});
+    arcLengths_.insert(arcLengths_.begin() + i * n + 1, n, start);
+    if (pickingIndexed_)
+        segmentGrid_.renumber(i, 1);
+    if (gpuProgram_ == nullptr && !curveOffsets_.empty()) {
+        const size_t offset = i < static_cast<int>(curveOffsets_.size())
+                                  ? curveOffsets_[i]
+                                  : curveGeometry_.Vtx().size() - 1;
+        curveOffsets_.insert(curveOffsets_.begin() + i, offset);
+        curveTolerances_.insert(curveTolerances_.begin() + i, tolerance_);
     }
+    rebuildSegments(i - 2, i + 1);
+    updateBlockBounds(i - 2, static_cast<int>(segments_.size()) - 1);
 
-    return cps_.back();
+    if (gpuProgram_ != nullptr)
+        uploadSegments(i - 2, static_cast<int>(segments_.size()) - 1);
+    else
+        retessellate(i - 2, i + 1);
 }
 
 
 /**
- * @brief Updates the spline's geometry data and evaluates the curve at multiple
- * sample points.
+ * Removes the control point with index i.
+ *
+ * The segment starting at the point (or ending at it, for the last point) is
+ * dropped, the following segments move one place back and the segments
+ * i - 2..i around the gap are rebuilt. The ids of the following control
+ * points and segments are shifted in the picking grids, and the block bounds
+ * after the point are recomputed.
  *
- * This method performs the following steps:
- * - Copies the control points to the geometry used for rendering the control
- * polygon.
- * - Updates the GPU for the control polygon geometry.
- * - Clears the current curve geometry vertices.
- * - If there are less than two control points, the method terminates after
- * updating the GPU with an empty set of curve vertices.
- * - Otherwise, it evaluates the spline at evenly spaced sample points between
- * the minimum and maximum parameter values.
- * - Adds the evaluated points to the curve geometry vertices.
- * - Finally, updates the GPU with the new set of curve vertices.
+ * @param i The index of the control point.
  */
-void Spline::update() {
-    controlGeometry_.Vtx() = cps_;
-    controlGeometry_.updateGPU();
-    curveGeometry_.Vtx().clear();
+void Spline::removeControlPoint(const int i) {
+    const int size = static_cast<int>(cps_.size());
+    if (i < 0 || i >= size)
+        return;
 
+    if (pickingIndexed_) {
+        pointGrid_.remove(i);
+        pointGrid_.renumber(i + 1, -1);
+    }
+    worldCps_.erase(worldCps_.begin() + i);
+    cps_.erase(cps_.begin() + i);
+    ts_.pop_back();
+    updateControlGeometry(i, cps_.size() - i);
     if (cps_.size() < 2) {
-        curveGeometry_.updateGPU();
+        segmentGrid_.clear();
+        rebuildSegments(0, -1);
+        tessellate(0);
         return;
     }
 
-    constexpr int samples = 100;
-    const float tMin = ts_.front();
-    const float tMax = ts_.back();
-
-    for (int i = 0; i <= samples; i++) {
-        const float t = tMin + (tMax - tMin) * i / samples;
-        curveGeometry_.Vtx().push_back(evaluate(t));
+    // The vertices of the dropped segment go to its neighbour, whose
+    // tessellation is rebuilt with the window
+    constexpr int n = arcLengthSubdivisions;
+    const int removed = std::min(i, size - 2);
+    if (pickingIndexed_) {
+        segmentGrid_.remove(removed);
+        segmentGrid_.renumber(removed + 1, -1);
+    }
+    segments_.erase(segments_.begin() + removed);
+    segmentBounds_.erase(segmentBounds_.begin() + removed);
+    arcLengths_.erase(arcLengths_.begin() + removed * n + 1,
+                      arcLengths_.begin() + (removed + 1) * n + 1);
+    if (gpuProgram_ == nullptr && !curveOffsets_.empty()) {
+        curveOffsets_.erase(curveOffsets_.begin() + std::max(removed, 1));
+        curveTolerances_.erase(curveTolerances_.begin() +
+                               std::max(removed, 1));
     }
+    rebuildSegments(i - 2, i);
+    updateBlockBounds(i - 2, static_cast<int>(segments_.size()) - 1);
 
-    curveGeometry_.updateGPU();
+    if (gpuProgram_ != nullptr)
+        uploadSegments(i - 2, static_cast<int>(segments_.size()) - 1);
+    else
+        retessellate(i - 2, i);
 }
 
 
 /**
- * Renders the spline curve and its control points using the GPU program and
- * model-view-projection matrix.
+ * Locates the segment [ts_[i], ts_[i + 1]] that contains the parameter t.
  *
- * This method first sets the "MVP" uniform in the given GPU program with the
- * provided matrix. If the spline contains at least two control points, it draws
- * the spline curve as a line strip in yellow color with a line width of 3. All
- * control points are then rendered as red points with a size of 10.
+ * The knots are sorted, so the segment is found with a binary search over
+ * them. If a hint is given, the segment it points to and the one after it are
+ * tried first, which makes monotonic queries (like the gondola advancing along
+ * the curve) amortized O(1). The hint is updated to the located segment.
  *
- * @param gpu A pointer to the GPUProgram used to set uniforms and render the
+ * @param t The parameter value to locate.
+ * @param hint Optional cursor holding the last segment found by the caller.
+ *
+ * @return The index of the first control point of the segment, or -1 if the
+ * spline has fewer than two control points or t is out of range.
+ */
+int Spline::findSegment(const double t, int* hint) const {
+    return locateInterval(ts_, t, hint);
+}
+
+
+/**
+ * Converts a parameter value to the arc length measured from the start of the
  * spline.
- * @param MVP A constant reference to the 4x4 model-view-projection matrix used
- * for rendering.
+ *
+ * The cumulative table gives the length up to the subdivision containing t,
+ * and only the rest of that subdivision is integrated.
+ *
+ * @param t The parameter value. Values out of range are clamped.
+ * @param hint Optional segment cursor forwarded to findSegment.
+ *
+ * @return The arc length from ts_.front() to t.
  */
-void Spline::draw(GPUProgram* gpu, const mat4& MVP) {
-    gpu->setUniform(MVP, "MVP");
+double Spline::tToS(const double t, int* hint) const {
+    if (cps_.size() < 2 || t <= ts_.front())
+        return 0.0;
+    if (t >= ts_.back())
+        return arcLengths_.back();
 
-    if (cps_.size() >= 2) {
-        glLineWidth(3.0f);
-        curveGeometry_.Draw(gpu, GL_LINE_STRIP, vec3(1, 1, 0));
+    constexpr int n = arcLengthSubdivisions;
+    const int i = findSegment(t, hint);
+    const float h = (ts_[i + 1] - ts_[i]) / n;
+    const auto u = static_cast<float>(t - ts_[i]);
+    const int k = std::min(static_cast<int>(u / h), n - 1);
+    return arcLengths_[i * n + k] + arcLength(segments_[i], h * k, u);
+}
+
+
+/**
+ * Converts an arc length measured from the start of the spline to the
+ * parameter value where it is reached.
+ *
+ * The subdivision containing s is located in the cumulative arc length table,
+ * then the local parameter is refined with Newton iterations on the partial
+ * length, which fall back to bisection when a step leaves the subdivision.
+ *
+ * @param s The arc length. Values out of range are clamped.
+ * @param hint Optional cursor into the arc length table.
+ *
+ * @return The parameter value at arc length s.
+ */
+double Spline::sToT(const double s, int* hint) const {
+    if (cps_.size() < 2 || s <= 0.0)
+        return cps_.empty() ? 0.0 : ts_.front();
+    if (s >= arcLengths_.back())
+        return ts_.back();
+
+    constexpr int n = arcLengthSubdivisions;
+    const int j = locateInterval(arcLengths_, s, hint);
+    const int i = j / n;
+    const CubicSegment& c = segments_[i];
+    const float h = (ts_[i + 1] - ts_[i]) / n;
+    const auto pieceLength =
+        static_cast<float>(arcLengths_[j + 1] - arcLengths_[j]);
+    const auto target = static_cast<float>(s - arcLengths_[j]);
+    float lo = h * (j - i * n), hi = lo + h;
+    if (pieceLength <= 0.0f)
+        return static_cast<double>(ts_[i]) + lo;
+
+    const float start = lo;
+    float u = lo + h * target / pieceLength;
+    for (int iteration = 0; iteration < 8; iteration++) {
+        const float error = arcLength(c, start, u) - target;
+        if (fabsf(error) <= 1e-6f * pieceLength)
+            break;
+        if (error > 0.0f)
+            hi = u;
+        else
+            lo = u;
+        const float speed = length(c.derivative(u));
+        const float next = speed > 0.0f ? u - error / speed : lo - 1.0f;
+        u = (next > lo && next < hi) ? next : 0.5f * (lo + hi);
     }
+    return static_cast<double>(ts_[i]) + u;
+}
 
-    glPointSize(10);
-    controlGeometry_.Draw(gpu, GL_POINTS, vec3(1, 0, 0));
+
+/**
+ * @brief Moves the local origin of the spline.
+ *
+ * The local tables are rounded again from the world control points
+ * relative to the new origin: the control points, a0 of every segment and
+ * the bounds, so the world position getOrigin() + p of the curve is
+ * unchanged and the points near the new origin get the full float
+ * precision, however far they were from the old one. The other coefficients,
+ * the parameters and the arc lengths do not depend on the origin, see
+ * localSegment. The tessellated vertices are shifted and re-tessellated
+ * from the new coefficients once they are drawn, see refine. It costs a pass
+ * over the tables and an upload of the geometry, so the origin is meant to
+ * jump now and then, when the gondolas moved a few tiles away, see
+ * rebaseOffset. Callers move everything else kept in local coordinates, like
+ * the cameras and the gondolas, by the same offset.
+ *
+ * @param offset The shift of the origin in local coordinates.
+ */
+void Spline::rebase(const vec2 offset) {
+    if (offset == vec2(0, 0))
+        return;
+    origin_ += dvec2(offset);
+    revision_++;
+    for (size_t i = 0; i < cps_.size(); i++)
+        cps_[i] = vec2(worldCps_[i] - origin_);
+    for (size_t i = 0; i < segments_.size(); i++) {
+        segments_[i].a0 = cps_[i];
+        segmentBounds_[i] = hullBounds(segments_[i], ts_[i + 1] - ts_[i]);
+    }
+    boundsLeaves_ = 0; // rebuilds the whole tree
+    updateBlockBounds(0, static_cast<int>(segments_.size()) - 1);
+    pointGrid_.clear();
+    segmentGrid_.clear();
+    pickingIndexed_ = false;
+
+    if (!renderable_)
+        return;
+    updateControlGeometry(0, cps_.size());
+    for (vec2& v : curveGeometry_.Vtx())
+        v -= offset;
+    std::fill(curveTolerances_.begin(), curveTolerances_.end(), -1.0f);
+    curveGeometry_.updateGPU();
+    if (gpuProgram_ != nullptr)
+        uploadSegments(0, static_cast<int>(segments_.size()) - 1);
 }
 
 
 /**
- * Retrieves the knots of the spline.
+ * @brief Computes how far to move the origin to keep a focus close to it.
  *
- * This method returns a constant reference to the internal vector containing
- * the knots of the spline. The knots represent the parameter values that define
- * the structure of the spline.
+ * @param focus A position in local coordinates, e.g. of the gondola.
+ * @return The whole originTile nearest to focus if focus is more than
+ * rebaseDistance from the origin along either axis, otherwise no offset;
+ * the offset to pass to rebase.
+ */
+vec2 Spline::rebaseOffset(const vec2 focus) {
+    if (!(fmaxf(fabsf(focus.x), fabsf(focus.y)) > rebaseDistance))
+        return vec2(0, 0); // also for a NaN focus
+    return vec2(roundf(focus.x / originTile), roundf(focus.y / originTile)) *
+           originTile;
+}
+
+
+/**
+ * @return The world position of the local origin, see rebase.
+ */
+dvec2 Spline::getOrigin() const { return origin_; }
+
+
+/**
+ * Evaluates the spline at the specified parameter t and returns the
+ * corresponding point on the curve.
  *
- * @return A constant reference to the vector of knots.
+ * This function evaluates the cached cubic coefficients of the Hermite segment
+ * between the control points that bound the parameter t. If the parameter t is outside the
+ * range of the spline, it returns the last control point.
+ *
+ * @param t The parameter value at which to evaluate the spline. It is expected
+ * to be within the range defined by the time values of the spline control
+ * points.
+ * @param hint Optional segment cursor forwarded to findSegment.
+ *
+ * @return A vec2 representing the point on the spline at the specified
+ * parameter t. If the spline contains fewer than two control points, returns
+ * vec2(0, 0).
  */
-const std::vector<float>& Spline::getKnots() const { return ts_; }
+vec2 Spline::evaluate(const double t, int* hint) const {
+    if (cps_.size() < 2)
+        return vec2(0, 0);
+
+    const int i = findSegment(t, hint);
+    if (i < 0)
+        return cps_.back();
+
+    return segments_[i].point(static_cast<float>(t - ts_[i]));
+}
+
+
+/**
+ * Computes the first derivative of the spline with respect to t.
+ *
+ * The derivative is evaluated analytically from the cached cubic coefficients
+ * of the segment that contains t.
+ *
+ * @param t The parameter value at which the derivative is calculated.
+ * @param hint Optional segment cursor forwarded to findSegment.
+ *
+ * @return The first derivative as a 2D vector, or vec2(0, 0) if t is out of
+ * range or the spline has fewer than two control points.
+ */
+vec2 Spline::derivative(const double t, int* hint) const {
+    const int i = findSegment(t, hint);
+    if (i < 0)
+        return vec2(0, 0);
+
+    return segments_[i].derivative(static_cast<float>(t - ts_[i]));
+}
+
+
+/**
+ * Computes the second derivative of the spline with respect to t.
+ *
+ * @param t The parameter value at which the second derivative is calculated.
+ * @param hint Optional segment cursor forwarded to findSegment.
+ *
+ * @return The second derivative as a 2D vector, or vec2(0, 0) if t is out of
+ * range or the spline has fewer than two control points.
+ */
+vec2 Spline::secondDerivative(const double t, int* hint) const {
+    const int i = findSegment(t, hint);
+    if (i < 0)
+        return vec2(0, 0);
+
+    return segments_[i].secondDerivative(static_cast<float>(t - ts_[i]));
+}
+
+
+/**
+ * Evaluates the position, the tangent and the second derivative of the spline
+ * in a single pass over the cached coefficients of one segment.
+ *
+ * Out of range parameters behave like evaluate: the position is the last
+ * control point and both derivatives are zero.
+ *
+ * @param t The parameter value at which the spline is evaluated.
+ * @param hint Optional segment cursor forwarded to findSegment.
+ *
+ * @return The position and its first two derivatives at t.
+ */
+SplineSample Spline::evaluateWithDerivatives(const double t,
+                                             int* hint) const {
+    SplineSample sample{vec2(0, 0), vec2(0, 0), vec2(0, 0)};
+    const int i = findSegment(t, hint);
+    if (i < 0) {
+        if (cps_.size() >= 2)
+            sample.position = cps_.back();
+        return sample;
+    }
+
+    const CubicSegment& c = segments_[i];
+    const auto u = static_cast<float>(t - ts_[i]);
+    sample.position = c.point(u);
+    sample.derivative = c.derivative(u);
+    sample.secondDerivative = c.secondDerivative(u);
+    return sample;
+}
+
+
+// The SIMD kernels read a segment as 8 consecutive floats: a0, a1, a2, a3
+static_assert(sizeof(CubicSegment) == 8 * sizeof(float));
+
+
+/**
+ * Evaluates a group of lanes of a batch with SIMD instructions.
+ *
+ * Lane k evaluates segment segment[k] at the local parameter u[k] with one
+ * vectorized Horner step, and writes the point to out[k]. The group has 8
+ * lanes with AVX2 and FMA and 4 with SSE2 or NEON; without SIMD it is a
+ * single scalar lane.
+ *
+ * @param segments The cubic coefficients of the spline.
+ * @param segment The segment indices of the lanes, all valid.
+ * @param u The local parameters of the lanes.
+ * @param out The points of the lanes.
+ */
+#if defined(__AVX2__) && defined(__FMA__)
+static constexpr int batchWidth = 8;
+
+static void evaluateLanes(const CubicSegment* segments, const int* segment,
+                          const float* u, vec2* out) {
+    const float* base = &segments[0].a0.x;
+    const __m256i index = _mm256_slli_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(segment)), 3);
+    __m256 c[8];
+    for (int k = 0; k < 8; k++)
+        c[k] = _mm256_i32gather_ps(
+            base, _mm256_add_epi32(index, _mm256_set1_epi32(k)), 4);
+
+    const __m256 s = _mm256_loadu_ps(u);
+    __m256 x = _mm256_fmadd_ps(c[6], s, c[4]);
+    __m256 y = _mm256_fmadd_ps(c[7], s, c[5]);
+    x = _mm256_fmadd_ps(_mm256_fmadd_ps(x, s, c[2]), s, c[0]);
+    y = _mm256_fmadd_ps(_mm256_fmadd_ps(y, s, c[3]), s, c[1]);
+
+    const __m256 lo = _mm256_unpacklo_ps(x, y);
+    const __m256 hi = _mm256_unpackhi_ps(x, y);
+    float* result = &out[0].x;
+    _mm256_storeu_ps(result, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(result + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+static constexpr int batchWidth = 4;
+
+static void evaluateLanes(const CubicSegment* segments, const int* segment,
+                          const float* u, vec2* out) {
+    // Rows (a0, a1) and (a2, a3) of four segments, transposed to columns
+    __m128 a0x = _mm_loadu_ps(&segments[segment[0]].a0.x);
+    __m128 a0y = _mm_loadu_ps(&segments[segment[1]].a0.x);
+    __m128 a1x = _mm_loadu_ps(&segments[segment[2]].a0.x);
+    __m128 a1y = _mm_loadu_ps(&segments[segment[3]].a0.x);
+    _MM_TRANSPOSE4_PS(a0x, a0y, a1x, a1y);
+    __m128 a2x = _mm_loadu_ps(&segments[segment[0]].a2.x);
+    __m128 a2y = _mm_loadu_ps(&segments[segment[1]].a2.x);
+    __m128 a3x = _mm_loadu_ps(&segments[segment[2]].a2.x);
+    __m128 a3y = _mm_loadu_ps(&segments[segment[3]].a2.x);
+    _MM_TRANSPOSE4_PS(a2x, a2y, a3x, a3y);
+
+    const __m128 s = _mm_loadu_ps(u);
+    __m128 x = _mm_add_ps(_mm_mul_ps(a3x, s), a2x);
+    __m128 y = _mm_add_ps(_mm_mul_ps(a3y, s), a2y);
+    x = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(x, s), a1x), s), a0x);
+    y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(y, s), a1y), s), a0y);
+
+    float* result = &out[0].x;
+    _mm_storeu_ps(result, _mm_unpacklo_ps(x, y));
+    _mm_storeu_ps(result + 4, _mm_unpackhi_ps(x, y));
+}
+#elif defined(__ARM_NEON)
+static constexpr int batchWidth = 4;
+
+// Transposes the rows r0..r3 into the columns c0..c3
+static void transpose(const float32x4_t r0, const float32x4_t r1,
+                      const float32x4_t r2, const float32x4_t r3,
+                      float32x4_t& c0, float32x4_t& c1, float32x4_t& c2,
+                      float32x4_t& c3) {
+    const float32x4x2_t t01 = vzipq_f32(r0, r1);
+    const float32x4x2_t t23 = vzipq_f32(r2, r3);
+    c0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    c1 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    c2 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    c3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+static void evaluateLanes(const CubicSegment* segments, const int* segment,
+                          const float* u, vec2* out) {
+    float32x4_t a0x, a0y, a1x, a1y, a2x, a2y, a3x, a3y;
+    transpose(vld1q_f32(&segments[segment[0]].a0.x),
+              vld1q_f32(&segments[segment[1]].a0.x),
+              vld1q_f32(&segments[segment[2]].a0.x),
+              vld1q_f32(&segments[segment[3]].a0.x), a0x, a0y, a1x, a1y);
+    transpose(vld1q_f32(&segments[segment[0]].a2.x),
+              vld1q_f32(&segments[segment[1]].a2.x),
+              vld1q_f32(&segments[segment[2]].a2.x),
+              vld1q_f32(&segments[segment[3]].a2.x), a2x, a2y, a3x, a3y);
+
+    const float32x4_t s = vld1q_f32(u);
+    float32x4_t x = vmlaq_f32(a2x, a3x, s);
+    float32x4_t y = vmlaq_f32(a2y, a3y, s);
+    x = vmlaq_f32(a0x, vmlaq_f32(a1x, x, s), s);
+    y = vmlaq_f32(a0y, vmlaq_f32(a1y, y, s), s);
+
+    float32x4x2_t xy;
+    xy.val[0] = x;
+    xy.val[1] = y;
+    vst2q_f32(&out[0].x, xy);
+}
+#else
+static constexpr int batchWidth = 1;
+
+static void evaluateLanes(const CubicSegment* segments, const int* segment,
+                          const float* u, vec2* out) {
+    out[0] = segments[segment[0]].point(u[0]);
+}
+#endif
+
+
+/**
+ * Evaluates the spline at many parameter values at once.
+ *
+ * The queries are processed in blocks: a first pass buckets every query into
+ * its segment, with a hint cursor so sorted or nearly sorted queries cost O(1)
+ * each, and a second pass evaluates the cached coefficients several queries
+ * per instruction (see evaluateLanes). The result matches evaluate, including
+ * the last control point for out of range parameters.
+ *
+ * @param t The parameter values, n of them.
+ * @param out The evaluated points, n of them.
+ * @param n The number of queries.
+ */
+void Spline::evaluateBatch(const double* t, vec2* out, const size_t n) const {
+    if (cps_.size() < 2) {
+        std::fill(out, out + n, vec2(0, 0));
+        return;
+    }
+
+    constexpr size_t blockSize = 256;
+    int found[blockSize];
+    int segment[blockSize];
+    float u[blockSize];
+    int hint = 0;
+
+    for (size_t first = 0; first < n; first += blockSize) {
+        const size_t count = std::min(blockSize, n - first);
+        for (size_t k = 0; k < count; k++) {
+            const int i = findSegment(t[first + k], &hint);
+            found[k] = i;
+            segment[k] = std::max(i, 0);
+            u[k] = i < 0 ? 0.0f : static_cast<float>(t[first + k] - ts_[i]);
+        }
+
+        size_t k = 0;
+        for (; k + batchWidth <= count; k += batchWidth)
+            evaluateLanes(segments_.data(), segment + k, u + k,
+                          out + first + k);
+        for (; k < count; k++)
+            out[first + k] = segments_[segment[k]].point(u[k]);
+
+        for (k = 0; k < count; k++)
+            if (found[k] < 0)
+                out[first + k] = cps_.back();
+    }
+}
+
+
+/**
+ * @brief Appends the vertices of segment i to vtx using adaptive subdivision.
+ *
+ * The segment is split recursively until every piece is flat enough: the
+ * Bezier control points of the piece, which bound it, must lie within the
+ * tolerance of its chord. Only the start point of each piece is emitted, so
+ * consecutive segments share their end points.
+ *
+ * @param i The index of the segment to tessellate.
+ * @param vtx The vertex list the samples are appended to.
+ */
+void Spline::tessellateSegment(const int i, std::vector<vec2>& vtx) const {
+    constexpr int maxDepth = 10;
+    const CubicSegment& c = segments_[i];
+
+    struct Piece {
+        float u0, u1;
+        int depth;
+    };
+    Piece stack[maxDepth + 1];
+    int top = 0;
+    stack[top++] = {0.0f, ts_[i + 1] - ts_[i], 0};
+
+    while (top > 0) {
+        const Piece piece = stack[--top];
+        const float h = piece.u1 - piece.u0;
+        const vec2 b0 = c.point(piece.u0);
+        const vec2 b3 = c.point(piece.u1);
+        const vec2 b1 = b0 + c.derivative(piece.u0) * (h / 3.0f);
+        const vec2 b2 = b3 - c.derivative(piece.u1) * (h / 3.0f);
+
+        const vec2 chord = b3 - b0;
+        const float chordLength = length(chord);
+        float deviation;
+        if (chordLength > 1e-6f) {
+            const float d1 = chord.x * (b1.y - b0.y) - chord.y * (b1.x - b0.x);
+            const float d2 = chord.x * (b2.y - b0.y) - chord.y * (b2.x - b0.x);
+            deviation = std::max(fabsf(d1), fabsf(d2)) / chordLength;
+        } else {
+            deviation = std::max(length(b1 - b0), length(b2 - b0));
+        }
+
+        if (deviation <= tolerance_ || piece.depth == maxDepth) {
+            vtx.push_back(b0);
+            continue;
+        }
+
+        // The second half is pushed first, so the first half is emitted first
+        const float um = 0.5f * (piece.u0 + piece.u1);
+        stack[top++] = {um, piece.u1, piece.depth + 1};
+        stack[top++] = {piece.u0, um, piece.depth + 1};
+    }
+}
+
+
+/**
+ * @brief Re-tessellates the curve from the given segment to the end and
+ * uploads the changed vertices to the GPU.
+ *
+ * Each segment is subdivided adaptively (see tessellateSegment) and the curve
+ * is closed with the last control point. The vertices of the segments before
+ * firstSegment are kept, so only the tail of the vertex buffer is rewritten.
+ * In GPU evaluation mode the changed segment coefficients are uploaded
+ * instead.
+ *
+ * @param firstSegment The index of the first segment whose vertices changed.
+ */
+void Spline::tessellate(int firstSegment) {
+    if (!renderable_)
+        return;
+    if (gpuProgram_ != nullptr) {
+        uploadSegments(firstSegment, static_cast<int>(segments_.size()) - 1);
+        return;
+    }
+
+    std::vector<vec2>& vtx = curveGeometry_.Vtx();
+    if (cps_.size() < 2) {
+        vtx.clear();
+        curveOffsets_.clear();
+        curveTolerances_.clear();
+        curveGeometry_.updateGPU();
+        return;
+    }
+
+    firstSegment = std::clamp(firstSegment, 0,
+                              static_cast<int>(curveOffsets_.size()));
+    const size_t firstVertex =
+        firstSegment < static_cast<int>(curveOffsets_.size())
+            ? curveOffsets_[firstSegment]
+            : vtx.size() - (vtx.empty() ? 0 : 1); // drop the closing vertex
+    vtx.resize(firstVertex);
+    curveOffsets_.resize(firstSegment);
+    curveTolerances_.resize(firstSegment);
+
+    for (int i = firstSegment; i < static_cast<int>(segments_.size()); i++) {
+        curveOffsets_.push_back(vtx.size());
+        curveTolerances_.push_back(tolerance_);
+        tessellateSegment(i, vtx);
+    }
+    vtx.push_back(cps_.back());
+
+    curveGeometry_.updateGPU(firstVertex, vtx.size() - firstVertex);
+}
+
+
+/**
+ * @brief Re-tessellates the segments firstSegment..lastSegment in place and
+ * uploads their vertices to the GPU.
+ *
+ * The vertices of the other segments are kept. If the new vertices fit into
+ * the range of the old ones, the rest of the range is padded with the last
+ * new vertex, which only adds zero length pieces to the strip, and just that
+ * range is uploaded. Otherwise the following vertices are moved back and
+ * uploaded as well. In GPU evaluation mode the coefficients of the segments
+ * are uploaded instead.
+ *
+ * @param firstSegment The index of the first segment whose shape changed.
+ * @param lastSegment The index of the last segment whose shape changed
+ * (inclusive).
+ */
+void Spline::retessellate(int firstSegment, int lastSegment) {
+    if (!renderable_)
+        return;
+    if (gpuProgram_ != nullptr) {
+        uploadSegments(firstSegment, lastSegment);
+        return;
+    }
+
+    const int segmentCount = static_cast<int>(segments_.size());
+    if (segmentCount == 0 ||
+        static_cast<int>(curveOffsets_.size()) != segmentCount) {
+        tessellate(0);
+        return;
+    }
+    firstSegment = std::max(firstSegment, 0);
+    lastSegment = std::min(lastSegment, segmentCount - 1);
+    if (firstSegment > lastSegment)
+        return;
+
+    std::vector<vec2>& vtx = curveGeometry_.Vtx();
+    const bool closing = lastSegment == segmentCount - 1;
+    const size_t begin = curveOffsets_[firstSegment];
+    const size_t end = closing ? vtx.size() : curveOffsets_[lastSegment + 1];
+
+    std::vector<vec2> window;
+    std::vector<size_t> starts;
+    for (int i = firstSegment; i <= lastSegment; i++) {
+        starts.push_back(window.size());
+        tessellateSegment(i, window);
+    }
+    if (closing)
+        window.push_back(cps_.back());
+    for (int i = firstSegment; i <= lastSegment; i++) {
+        curveOffsets_[i] = begin + starts[i - firstSegment];
+        curveTolerances_[i] = tolerance_;
+    }
+
+    if (window.size() <= end - begin) {
+        window.resize(end - begin, window.back());
+        std::copy(window.begin(), window.end(), vtx.begin() + begin);
+        curveGeometry_.updateGPU(begin, end - begin);
+        return;
+    }
+
+    const size_t grow = window.size() - (end - begin);
+    vtx.insert(vtx.begin() + end, grow, vec2(0, 0));
+    std::copy(window.begin(), window.end(), vtx.begin() + begin);
+    for (int i = lastSegment + 1; i < segmentCount; i++)
+        curveOffsets_[i] += grow;
+    curveGeometry_.updateGPU(begin, vtx.size() - begin);
+}
+
+
+/**
+ * @brief Re-tessellates the segments of the given runs that were tessellated
+ * with another tolerance, see setTolerance.
+ *
+ * Consecutive stale segments are rebuilt with one retessellate each, so a
+ * zoom only pays for the part of the curve being drawn.
+ *
+ * @param ranges The runs of segments about to be drawn.
+ */
+void Spline::refine(const std::vector<SegmentRange>& ranges) {
+    if (!renderable_ || gpuProgram_ != nullptr ||
+        curveTolerances_.size() != segments_.size())
+        return;
+    for (const SegmentRange& range : ranges) {
+        for (int i = range.first; i < range.last;) {
+            if (curveTolerances_[i] == tolerance_) {
+                i++;
+                continue;
+            }
+            int stale = i + 1;
+            while (stale < range.last && curveTolerances_[stale] != tolerance_)
+                stale++;
+            retessellate(i, stale - 1);
+            i = stale;
+        }
+    }
+}
+
+
+/**
+ * @brief Uploads the coefficients of the segments firstSegment..lastSegment
+ * into the segment texture buffer.
+ *
+ * Every segment takes two texels holding its coefficients rescaled to the
+ * normalized parameter s in [0, 1]: (a0, b1) and (b2, b3). The largest second
+ * derivative with respect to s is tracked, since it bounds the chord error used
+ * to pick the number of samples per segment. It follows the edits both ways:
+ * when the segment holding it is flattened or removed, the bound is taken
+ * again from the per-segment values.
+ *
+ * @param firstSegment The index of the first segment whose coefficients
+ * changed.
+ * @param lastSegment The index of the last segment whose coefficients changed
+ * (inclusive).
+ */
+void Spline::uploadSegments(int firstSegment, int lastSegment) {
+    if (!renderable_)
+        return;
+    firstSegment = std::max(firstSegment, 0);
+    lastSegment =
+        std::min(lastSegment, static_cast<int>(segments_.size()) - 1);
+    segmentTexels_.resize(2 * segments_.size());
+
+    // The largest acceleration is rescanned only if the segment holding it
+    // was dropped or got a smaller one
+    bool lowered = false;
+    for (size_t i = segments_.size(); i < segmentAccelerations_.size(); i++)
+        lowered |= segmentAccelerations_[i] >= maxAcceleration_;
+    segmentAccelerations_.resize(segments_.size());
+    for (int i = firstSegment; i <= lastSegment; i++) {
+        const CubicSegment& c = segments_[i];
+        const float dt = ts_[i + 1] - ts_[i];
+        const vec2 b1 = c.a1 * dt;
+        const vec2 b2 = c.a2 * (dt * dt);
+        const vec2 b3 = c.a3 * (dt * dt * dt);
+        segmentTexels_[2 * i] = vec4(c.a0.x, c.a0.y, b1.x, b1.y);
+        segmentTexels_[2 * i + 1] = vec4(b2.x, b2.y, b3.x, b3.y);
+        const float acceleration =
+            std::max(length(2.0f * b2), length(2.0f * b2 + 6.0f * b3));
+        lowered |= segmentAccelerations_[i] >= maxAcceleration_ &&
+                   acceleration < maxAcceleration_;
+        segmentAccelerations_[i] = acceleration;
+        maxAcceleration_ = std::max(maxAcceleration_, acceleration);
+    }
+    if (lowered)
+        maxAcceleration_ =
+            segmentAccelerations_.empty()
+                ? 0.0f
+                : *std::max_element(segmentAccelerations_.begin(),
+                                    segmentAccelerations_.end());
+
+    if (firstSegment <= lastSegment)
+        segmentBuffer_.update(
+            segmentTexels_, 2 * static_cast<size_t>(firstSegment),
+            2 * static_cast<size_t>(lastSegment - firstSegment + 1));
+}
+
+
+/**
+ * @brief Computes how many vertices the GPU evaluation mode emits per segment.
+ *
+ * A chord spanning the parameter range h deviates from the curve by at most
+ * |P''| * h^2 / 8, so the count follows from the tolerance and the largest
+ * second derivative. Changing the tolerance (e.g. when zooming) therefore only
+ * changes a uniform.
+ *
+ * @return The number of samples per segment, between 1 and 256.
+ */
+int Spline::gpuSamplesPerSegment() const {
+    const float samples = ceilf(sqrtf(maxAcceleration_ / (8.0f * tolerance_)));
+    return std::clamp(static_cast<int>(samples), 1, 256);
+}
+
+
+/**
+ * @brief Sets the flatness tolerance of the curve tessellation.
+ *
+ * The tolerance is the largest allowed distance, in world units, between the
+ * curve and its polyline approximation. Nothing is re-tessellated right away:
+ * draw and drawView re-tessellate the segments they draw, so after a zoom
+ * only the visible part of the curve is rebuilt and the rest keeps its
+ * vertices until it comes into view. In GPU evaluation mode only the
+ * per-segment sample count of the next draw changes.
+ *
+ * @param tolerance The new tolerance in world units. Must be positive.
+ */
+void Spline::setTolerance(const float tolerance) {
+    if (tolerance <= 0.0f || tolerance == tolerance_)
+        return;
+    tolerance_ = tolerance;
+}
+
+
+/**
+ * @brief Switches between CPU tessellation and GPU evaluation of the curve.
+ *
+ * In GPU evaluation mode only the segment coefficients are uploaded, and the
+ * given program evaluates the curve from gl_VertexID. The program must read
+ * the coefficients from the samplerBuffer "segments" and use the uniforms
+ * "segmentCount", "samplesPerSegment", "MVP" and "color".
+ *
+ * @param program The program evaluating the curve, or nullptr to return to
+ * CPU tessellation. Ignored by a spline that is not renderable.
+ */
+void Spline::setGPUEvaluation(GPUProgram* program) {
+    if (program == gpuProgram_ || !renderable_)
+        return;
+    gpuProgram_ = program;
+
+    if (gpuProgram_ != nullptr) {
+        if (curveVao_ == 0)
+            glGenVertexArrays(1, &curveVao_);
+        curveGeometry_.Vtx().clear();
+        curveOffsets_.clear();
+        curveTolerances_.clear();
+        uploadSegments(0, static_cast<int>(segments_.size()) - 1);
+    } else {
+        tessellate(0);
+    }
+}
+
+
+/**
+ * @return True if the curve is evaluated on the GPU.
+ */
+bool Spline::usesGPUEvaluation() const { return gpuProgram_ != nullptr; }
+
+
+/**
+ * @return False if the spline was created without GPU resources, see
+ * Spline::Spline.
+ */
+bool Spline::isRenderable() const { return renderable_; }
+
+
+/**
+ * @brief Rebuilds the spline's geometry data from scratch.
+ *
+ * Copies the control points to the geometry used for rendering the control
+ * polygon, uploads it, and re-tessellates the whole curve. Editing control
+ * points does not need this, since addControlPoint, moveControlPoint,
+ * insertControlPoint and removeControlPoint update the geometry
+ * incrementally.
+ */
+void Spline::update() {
+    ProfileZone zone("Spline::update", true);
+    updateControlGeometry(0, cps_.size());
+    tessellate(0);
+}
+
+
+/**
+ * @param i The index of the segment.
+ * @return The bounds of the control hull of segment i, which contain the
+ * whole segment.
+ */
+const WorldRect& Spline::getSegmentBounds(const int i) const {
+    return segmentBounds_[i];
+}
+
+
+/**
+ * @brief Finds the runs of segments overlapping a world rectangle.
+ *
+ * The bounds tree is descended from the root into the overlapping nodes
+ * only, and the segments are tested in the overlapping leaves, so the cost
+ * grows with the visible part of the track and the logarithm of its length.
+ * The children are visited left first, which yields the runs in order.
+ *
+ * @param view The visible world rectangle, e.g. Camera::worldRect.
+ * @param ranges Receives the maximal runs of overlapping segments, in order.
+ */
+void Spline::visibleSegments(const WorldRect& view,
+                             std::vector<SegmentRange>& ranges) const {
+    ranges.clear();
+    if (boundsTree_.empty())
+        return;
+    const int segmentCount = static_cast<int>(segments_.size());
+    int stack[64]; // two entries per level of the tree at most
+    int top = 0;
+    stack[top++] = 1;
+    while (top > 0) {
+        const int node = stack[--top];
+        if (!boundsTree_[node].overlaps(view))
+            continue;
+        if (node < boundsLeaves_) {
+            stack[top++] = 2 * node + 1;
+            stack[top++] = 2 * node;
+            continue;
+        }
+        const int begin = (node - boundsLeaves_) * boundsBlockSize;
+        const int stop = std::min(begin + boundsBlockSize, segmentCount);
+        for (int i = begin; i < stop; i++) {
+            if (!segmentBounds_[i].overlaps(view))
+                continue;
+            if (!ranges.empty() && ranges.back().last == i)
+                ranges.back().last++;
+            else
+                ranges.push_back({i, i + 1});
+        }
+    }
+}
+
+
+/**
+ * @brief Finds the control point nearest to p within a radius.
+ *
+ * Only the control points listed in the picking grid cells around p are
+ * tested, so the query does not depend on the number of control points.
+ *
+ * @param p The query point in world coordinates, e.g. from
+ * Camera::pixelToWorld.
+ * @param radius The largest accepted distance.
+ * @return The index of the nearest control point, or -1 if there is none
+ * within radius.
+ */
+int Spline::nearestControlPoint(const vec2 p, const float radius) const {
+    indexForPicking();
+    pointGrid_.query(WorldRect{p, p}.expanded(radius), candidates_);
+    int nearest = -1;
+    float nearestDistance = radius;
+    for (const int i : candidates_) {
+        const float distance = length(cps_[i] - p);
+        if (distance <= nearestDistance) {
+            nearest = i;
+            nearestDistance = distance;
+        }
+    }
+    return nearest;
+}
+
+
+/**
+ * @brief Finds the point of the curve closest to p within a radius.
+ *
+ * The candidate segments come from the picking grid. On each, the squared
+ * distance is minimized by sampling the segment and refining the best sample
+ * with a few safeguarded Newton steps between its neighbouring samples.
+ *
+ * @param p The query point in world coordinates.
+ * @param radius The largest accepted distance.
+ * @param hit Receives the segment, parameter, point and distance of the
+ * closest point of the curve.
+ * @return True if a point of the curve lies within radius.
+ */
+bool Spline::closestPointOnCurve(const vec2 p, const float radius,
+                                 CurveHit& hit) const {
+    constexpr int samples = 8;
+    constexpr int newtonSteps = 8;
+    const WorldRect box = WorldRect{p, p}.expanded(radius);
+    indexForPicking();
+    segmentGrid_.query(box, candidates_);
+
+    bool found = false;
+    float best = radius;
+    for (const int i : candidates_) {
+        if (!segmentBounds_[i].overlaps(box))
+            continue;
+        const CubicSegment& c = segments_[i];
+        const float h = ts_[i + 1] - ts_[i];
+
+        float u = 0.0f;
+        float uDistance = length(c.point(0.0f) - p);
+        for (int k = 1; k <= samples; k++) {
+            const float uk = h * k / samples;
+            const float distance = length(c.point(uk) - p);
+            if (distance < uDistance) {
+                u = uk;
+                uDistance = distance;
+            }
+        }
+        // Safeguarded Newton on the derivative of the squared distance,
+        // bracketed by the neighbouring samples
+        float lo = std::max(u - h / samples, 0.0f);
+        float hi = std::min(u + h / samples, h);
+        float v = u;
+        for (int k = 0; k < newtonSteps; k++) {
+            const vec2 d = c.point(v) - p;
+            const vec2 d1 = c.derivative(v);
+            const float f1 = dot(d, d1);
+            const float f2 = dot(d1, d1) + dot(d, c.secondDerivative(v));
+            if (f1 > 0.0f)
+                hi = v;
+            else
+                lo = v;
+            float next = f2 > 0.0f ? v - f1 / f2 : lo - 1.0f;
+            if (next < lo || next > hi)
+                next = 0.5f * (lo + hi);
+            if (std::abs(next - v) <= 1e-6f * h)
+                break;
+            v = next;
+        }
+        if (length(c.point(v) - p) < uDistance)
+            u = v;
+
+        const vec2 point = c.point(u);
+        const float distance = length(point - p);
+        if (distance <= best) {
+            best = distance;
+            hit = {i, ts_[i] + u, point, distance};
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * @brief Draws the curve with the evaluation program in GPU evaluation mode.
+ *
+ * The curve is drawn as a yellow line strip of width 3, evaluated from the
+ * segment texture buffer without any vertex buffer. With a view only the
+ * visible segment runs are drawn, as the strips of one glMultiDrawArrays whose
+ * first vertices select the segments. The evaluation program stays in use.
+ *
+ * @param MVP The model-view-projection matrix of the scene.
+ * @param view Optional visible world rectangle to cull the segments against.
+ * @return True if the curve was drawn, false outside GPU evaluation mode or
+ * with fewer than two control points.
+ */
+bool Spline::drawGPUCurve(const mat4& MVP, const WorldRect* view) {
+    ProfileZone zone("Spline::drawGPUCurve", true);
+    if (cps_.size() < 2 || gpuProgram_ == nullptr)
+        return false;
+
+    std::vector<SegmentRange> ranges;
+    if (view != nullptr)
+        visibleSegments(*view, ranges);
+    else
+        ranges.push_back({0, static_cast<int>(segments_.size())});
+    gpuProgram_->Use();
+    gpuProgram_->setUniform(MVP, "MVP");
+    drawGPUStrips(ranges);
+    return true;
+}
+
+
+/**
+ * @brief Draws segment runs with the evaluation program, which is in use.
+ *
+ * Every run is one strip of a glMultiDrawArrays; the MVP is left to the
+ * caller.
+ *
+ * @param ranges The runs of segments to draw.
+ */
+void Spline::drawGPUStrips(const std::vector<SegmentRange>& ranges) {
+    const int samples = gpuSamplesPerSegment();
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+    for (const SegmentRange& range : ranges) {
+        firsts.push_back(range.first * samples);
+        counts.push_back((range.last - range.first) * samples + 1);
+    }
+
+    gpuProgram_->setUniform(vec3(1, 1, 0), "color");
+    gpuProgram_->setUniform(0, "segments");
+    gpuProgram_->setUniform(static_cast<int>(segments_.size()),
+                            "segmentCount");
+    gpuProgram_->setUniform(samples, "samplesPerSegment");
+    segmentBuffer_.Bind(0);
+    glLineWidth(3.0f);
+    glBindVertexArray(curveVao_);
+    glMultiDrawArrays(GL_LINE_STRIP, firsts.data(), counts.data(),
+                      static_cast<GLsizei>(firsts.size()));
+}
+
+
+/**
+ * @brief Queues the curve and the control points in a BatchRenderer.
+ *
+ * The same picture as draw: the curve as a yellow line strip of width 3 on
+ * the curve layer, unless it is drawn by drawGPUCurve, and the control points
+ * as red points of size 10 above it. With a view only the visible segment
+ * runs of the tessellated curve are queued, found with visibleSegments and
+ * mapped to vertices with curveOffsets_, together with their control points.
+ * The segments are queued with the tessellation they have; drawView and draw
+ * are the ones following the tolerance.
+ *
+ * @param batch The renderer of the frame.
+ * @param view Optional visible world rectangle to cull the segments against;
+ * it should include a margin for the line width and point size.
+ */
+void Spline::submit(BatchRenderer& batch, const WorldRect* view) const {
+    const vec3 curveColor(1, 1, 0), pointColor(1, 0, 0);
+    if (view == nullptr || segments_.empty()) {
+        if (cps_.size() >= 2 && gpuProgram_ == nullptr) {
+            const std::vector<vec2>& curve = curveGeometry_.Vtx();
+            batch.submit(CurveLayer, GL_LINE_STRIP, curve.data(),
+                         curve.size(), curveColor, 3.0f);
+        }
+        batch.submit(ControlPointLayer, GL_POINTS, cps_.data(), cps_.size(),
+                     pointColor, 10.0f);
+        return;
+    }
+
+    std::vector<SegmentRange> ranges;
+    visibleSegments(*view, ranges);
+    const std::vector<vec2>& curve = curveGeometry_.Vtx();
+    const int segmentCount = static_cast<int>(segments_.size());
+    for (const SegmentRange& range : ranges) {
+        if (gpuProgram_ == nullptr) {
+            const size_t first = curveOffsets_[range.first];
+            const size_t last = range.last < segmentCount
+                                    ? curveOffsets_[range.last]
+                                    : curve.size() - 1;
+            batch.submit(CurveLayer, GL_LINE_STRIP, curve.data() + first,
+                         last - first + 1, curveColor, 3.0f);
+        }
+        batch.submit(ControlPointLayer, GL_POINTS, cps_.data() + range.first,
+                     range.last - range.first + 1, pointColor, 10.0f);
+    }
+}
+
+
+/**
+ * Renders the spline curve and its control points using the GPU program and
+ * model-view-projection matrix.
+ *
+ * This method first sets the "MVP" uniform in the given GPU program with the
+ * provided matrix. If the spline contains at least two control points, it draws
+ * the spline curve as a line strip in yellow color with a line width of 3. In
+ * GPU evaluation mode the curve is drawn by the evaluation program without any
+ * vertex buffer. All control points are then rendered as red points with a
+ * size of 10.
+ *
+ * @param gpu A pointer to the GPUProgram used to set uniforms and render the
+ * spline.
+ * @param MVP A constant reference to the 4x4 model-view-projection matrix used
+ * for rendering.
+ */
+void Spline::draw(GPUProgram* gpu, const mat4& MVP) {
+    if (drawGPUCurve(MVP))
+        gpu->Use();
+
+    const UniformHandle color = gpu->uniform("color");
+    gpu->setUniform(MVP, gpu->uniform("MVP"));
+
+    if (cps_.size() >= 2 && gpuProgram_ == nullptr) {
+        refine({{0, static_cast<int>(segments_.size())}});
+        glLineWidth(3.0f);
+        curveGeometry_.Draw(gpu, GL_LINE_STRIP, vec3(1, 1, 0), color);
+    }
+
+    glPointSize(10);
+    controlGeometry_.Draw(gpu, GL_POINTS, vec3(1, 0, 0), color);
+}
+
+
+/**
+ * @brief Draws the curve and the control points from their GPU buffers.
+ *
+ * The picture of submit, drawn straight from the curve and control point
+ * geometry the spline keeps uploaded, or in GPU evaluation mode from the
+ * segment texture, so the views of a frame share the same buffers. With a
+ * view only the visible segment runs and their control points are drawn.
+ * Segments tessellated with an older tolerance are re-tessellated first, see
+ * setTolerance; otherwise nothing is uploaded per view. No matrix uniform is
+ * set: the programs take their MVP from elsewhere, e.g. a View uniform
+ * block, see ViewSet.
+ *
+ * @param gpu The program with a uniform color drawing the tessellated curve
+ * and the control points; it is in use afterwards.
+ * @param view Optional visible world rectangle to cull the segments against;
+ * it should include a margin for the line width and point size.
+ */
+void Spline::drawView(GPUProgram* gpu, const WorldRect* view) {
+    ProfileZone zone("Spline::drawView", true);
+    const int segmentCount = static_cast<int>(segments_.size());
+    std::vector<SegmentRange> ranges;
+    const bool culled = view != nullptr && segmentCount > 0;
+    if (culled)
+        visibleSegments(*view, ranges);
+    else if (segmentCount > 0)
+        ranges.push_back({0, segmentCount});
+    refine(ranges);
+
+    if (cps_.size() >= 2 && gpuProgram_ != nullptr) {
+        gpuProgram_->Use();
+        drawGPUStrips(ranges);
+    }
+    gpu->Use();
+    const UniformHandle color = gpu->uniform("color");
+    if (cps_.size() >= 2 && gpuProgram_ == nullptr) {
+        const int vertexCount = static_cast<int>(curveGeometry_.Vtx().size());
+        glLineWidth(3.0f);
+        for (const SegmentRange& range : ranges) {
+            const int first = static_cast<int>(curveOffsets_[range.first]);
+            const int last =
+                range.last < segmentCount
+                    ? static_cast<int>(curveOffsets_[range.last])
+                    : vertexCount - 1;
+            curveGeometry_.Draw(gpu, GL_LINE_STRIP, vec3(1, 1, 0), color,
+                                first, last - first + 1);
+        }
+    }
+
+    glPointSize(10);
+    if (!culled) {
+        controlGeometry_.Draw(gpu, GL_POINTS, vec3(1, 0, 0), color);
+        return;
+    }
+    for (const SegmentRange& range : ranges)
+        controlGeometry_.Draw(gpu, GL_POINTS, vec3(1, 0, 0), color,
+                              range.first, range.last - range.first + 1);
+}
+
+
+/**
+ * @brief Retrieves the control points of the spline.
+ *
+ * @return A constant reference to the vector of control points in local
+ * coordinates, relative to getOrigin(), in the order they were added.
+ */
+const std::vector<vec2>& Spline::getControlPoints() const { return cps_; }
+
+
+/**
+ * @return The control points in world coordinates, getOrigin() plus
+ * getControlPoints() in double.
+ */
+const std::vector<dvec2>& Spline::getWorldControlPoints() const {
+    return worldCps_;
+}
+
+
+/**
+ * Retrieves the knots of the spline.
+ *
+ * This method returns a constant reference to the internal vector containing
+ * the knots of the spline. The knots represent the parameter values that define
+ * the structure of the spline.
+ *
+ * @return A constant reference to the vector of knots.
+ */
+const std::vector<float>& Spline::getKnots() const { return ts_; }
+
+
+/**
+ * @return The coefficients of the segments, one per pair of neighbouring
+ * control points.
+ */
+const std::vector<CubicSegment>& Spline::getSegments() const {
+    return segments_;
+}
+
+
+/**
+ * @return The cumulative arc length table: a leading zero and
+ * arcLengthSubdivisions entries per segment.
+ */
+const std::vector<double>& Spline::getArcLengths() const {
+    return arcLengths_;
+}
+
+
+/**
+ * Retrieves the total arc length of the spline.
+ *
+ * @return The length of the curve, or 0 if it has fewer than two control
+ * points.
+ */
+double Spline::getLength() const {
+    return arcLengths_.empty() ? 0.0 : arcLengths_.back();
+}
+
+
+/**
+ * Counts the changes of the curve.
+ *
+ * Every edit of the control points changes the revision, so copies of the
+ * segment and arc length tables, e.g. on the GPU, can tell when they are
+ * stale without comparing the tables.
+ *
+ * @return A number that changes whenever the segments or the arc length table
+ * do.
+ */
+size_t Spline::getRevision() const { return revision_; }
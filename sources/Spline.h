@@ -1,8 +1,66 @@
 #ifndef SPLINE_H
 #define SPLINE_H
 
+#include "BatchRenderer.h"
 #include "Camera.h"
+#include "SpatialGrid.h"
 
+#include <span>
+
+
+/**
+ * @struct CubicSegment
+ * @brief Power-basis coefficients of one Hermite segment.
+ *
+ * The segment is expressed in the local parameter u = t - t0 as
+ * p(u) = ((a3 * u + a2) * u + a1) * u + a0, so evaluating it is a single
+ * Horner step with no divisions.
+ */
+struct CubicSegment {
+    vec2 a0, a1, a2, a3;
+
+    vec2 point(const float u) const {
+        return ((a3 * u + a2) * u + a1) * u + a0;
+    }
+
+    vec2 derivative(const float u) const {
+        return (a3 * (3.0f * u) + a2 * 2.0f) * u + a1;
+    }
+
+    vec2 secondDerivative(const float u) const {
+        return a3 * (6.0f * u) + a2 * 2.0f;
+    }
+};
+
+
+/**
+ * @struct SplineSample
+ * @brief Position and first two derivatives of the spline at one parameter.
+ */
+struct SplineSample {
+    vec2 position;
+    vec2 derivative;
+    vec2 secondDerivative;
+};
+
+
+// The segments [first, last) of a spline
+struct SegmentRange {
+    int first, last;
+};
+
+
+// Point of a spline closest to a query point, see Spline::closestPointOnCurve
+struct CurveHit {
+    int segment;
+    float t;
+    vec2 point;
+    float distance;
+};
+
+
+CubicSegment HermiteCoefficients(const vec2& p0, const vec2& v0, float t0,
+                                 const vec2& p1, const vec2& v1, float t1);
 
 vec2 Hermite(const vec2& p0, const vec2& v0, float t0, const vec2& p1,
              const vec2& v1, float t1, float t);
@@ -14,26 +72,192 @@ vec2 Hermite(const vec2& p0, const vec2& v0, float t0, const vec2& p1,
  *
  * The Spline class allows the creation, evaluation, rendering, and modification
  * of a Catmull-Rom spline curve based on user-specified control points.
- * It supports dynamic updates when control points are added and provides
- * methods to evaluate the curve and its derivative at given parameter values.
+ * It supports dynamic updates when control points are added, moved, inserted
+ * or removed, and provides methods to evaluate the curve and its derivative at
+ * given parameter values. An edit only rebuilds the few segments depending on
+ * the edited control point.
+ * The curve is either tessellated on the CPU or, in GPU evaluation mode,
+ * evaluated per vertex by a shader from the uploaded segment coefficients.
+ *
+ * The control points are kept in double world coordinates. Everything
+ * derived from them is float relative to a movable origin: the local copy of
+ * the control points, the segment coefficients, the bounds and the geometry.
+ * The coefficients other than a0 are computed from double differences, so
+ * the tangents and curvatures are as precise far from the origin as near it.
+ * Positions are only as precise as a float at their distance from the
+ * origin, so rebase moves the origin close to the gondolas, and the floats
+ * evaluated, tessellated and sent to the GPU stay small there. The
+ * parameters passed in and out and the arc lengths are doubles. The knots are
+ * the integers 0, 1, 2, ... held as float, which is exact up to
+ * maxControlPoints control points.
  */
 class Spline {
 
-    std::vector<vec2> cps_;
+  public:
+    // Entries of the arc length table per segment
+    static constexpr int arcLengthSubdivisions = 8;
+    // Control points whose float knots are exact, see the class comment
+    static constexpr size_t maxControlPoints = size_t{1} << 24;
+    // The origin moves in whole tiles once the focus of the scene is more
+    // than rebaseDistance world units from it, see rebaseOffset
+    static constexpr float originTile = 1024.0f;
+    static constexpr float rebaseDistance = 2048.0f;
+
+  private:
+    // Segments per leaf of the tree of culling bounds
+    static constexpr int boundsBlockSize = 32;
+    // Cell size of the picking grids in world units before there are
+    // segments to size them by, and the smallest one, see fitPickingCells
+    static constexpr float pickingCellSize = 2.0f;
+    static constexpr float minPickingCellSize = 1e-3f;
+
+    std::vector<dvec2> worldCps_; // world positions of the control points
+    std::vector<vec2> cps_;       // worldCps_ relative to origin_
     std::vector<float> ts_;
+    std::vector<CubicSegment> segments_;
+    std::vector<double> arcLengths_;
+    std::vector<size_t> curveOffsets_;
+    std::vector<float> curveTolerances_; // tolerance of each tessellation
+    std::vector<WorldRect> segmentBounds_;
+    // Binary tree over blocks of boundsBlockSize segments: node 1 is the
+    // root, node k has the children 2k and 2k + 1, and block b is leaf
+    // boundsLeaves_ + b
+    std::vector<WorldRect> boundsTree_;
+    int boundsLeaves_ = 0;
+    int boundsBlocks_ = 0;
+    // Built on demand after assign, see indexForPicking
+    mutable SpatialGrid pointGrid_{pickingCellSize};
+    mutable SpatialGrid segmentGrid_{pickingCellSize};
+    mutable bool pickingIndexed_ = true;
+    mutable std::vector<int> candidates_; // scratch of the picking queries
+    // Incremented by every change of the segments, see getRevision
+    size_t revision_ = 0;
+    // World position of the local origin of the tables, see rebase
+    dvec2 origin_{0, 0};
+    float tolerance_ = 0.01f;
+    bool renderable_;
     Geometry<vec2> controlGeometry_;
     Geometry<vec2> curveGeometry_;
 
+    GPUProgram* gpuProgram_ = nullptr;
+    TextureBuffer segmentBuffer_;
+    std::vector<vec4> segmentTexels_;
+    std::vector<float> segmentAccelerations_; // see uploadSegments
+    float maxAcceleration_ = 0.0f;
+    unsigned int curveVao_ = 0;
+
+    dvec2 tangent(int i) const;
+
+    CubicSegment localSegment(int i) const;
+
+    void rebuildSegments(int first, int last);
+
+    void updateControlGeometry(size_t first, size_t count);
+
+    void updateBlockBounds(int firstSegment, int lastSegment);
+
+    void indexForPicking() const;
+
+    void fitPickingCells() const;
+
+    void tessellateSegment(int i, std::vector<vec2>& vtx) const;
+
+    void tessellate(int firstSegment);
+
+    void retessellate(int firstSegment, int lastSegment);
+
+    void refine(const std::vector<SegmentRange>& ranges);
+
+    void uploadSegments(int firstSegment, int lastSegment);
+
+    int gpuSamplesPerSegment() const;
+
+    void drawGPUStrips(const std::vector<SegmentRange>& ranges);
+
   public:
+    explicit Spline(bool renderable = true);
+
+    ~Spline();
+
     void addControlPoint(vec2 cp);
 
-    vec2 evaluate(float t) const;
+    void addControlPoints(std::span<const vec2> points);
+
+    void reserve(size_t count);
+
+    void assign(const dvec2* points, const float* knots, size_t count,
+                const CubicSegment* segments = nullptr,
+                const double* arcLengths = nullptr,
+                dvec2 origin = dvec2(0, 0));
+
+    void moveControlPoint(int i, vec2 cp);
+
+    void insertControlPoint(int i, vec2 cp);
+
+    void removeControlPoint(int i);
+
+    int findSegment(double t, int* hint = nullptr) const;
+
+    vec2 evaluate(double t, int* hint = nullptr) const;
+
+    vec2 derivative(double t, int* hint = nullptr) const;
+
+    vec2 secondDerivative(double t, int* hint = nullptr) const;
+
+    SplineSample evaluateWithDerivatives(double t, int* hint = nullptr) const;
+
+    void evaluateBatch(const double* t, vec2* out, size_t n) const;
+
+    double tToS(double t, int* hint = nullptr) const;
+
+    double sToT(double s, int* hint = nullptr) const;
+
+    void rebase(vec2 offset);
+
+    static vec2 rebaseOffset(vec2 focus);
+
+    dvec2 getOrigin() const;
+
+    void setTolerance(float tolerance);
+
+    void setGPUEvaluation(GPUProgram* program);
+
+    bool usesGPUEvaluation() const;
+
+    bool isRenderable() const;
 
     void update();
 
+    const WorldRect& getSegmentBounds(int i) const;
+
+    void visibleSegments(const WorldRect& view,
+                         std::vector<SegmentRange>& ranges) const;
+
+    int nearestControlPoint(vec2 p, float radius) const;
+
+    bool closestPointOnCurve(vec2 p, float radius, CurveHit& hit) const;
+
+    bool drawGPUCurve(const mat4& MVP, const WorldRect* view = nullptr);
+
     void draw(GPUProgram* gpu, const mat4& MVP);
 
+    void drawView(GPUProgram* gpu, const WorldRect* view = nullptr);
+
+    void submit(BatchRenderer& batch, const WorldRect* view = nullptr) const;
+
+    const std::vector<vec2>& getControlPoints() const;
+
+    const std::vector<dvec2>& getWorldControlPoints() const;
+
     const std::vector<float>& getKnots() const;
+
+    const std::vector<CubicSegment>& getSegments() const;
+
+    const std::vector<double>& getArcLengths() const;
+
+    double getLength() const;
+
+    size_t getRevision() const;
 };
 
 
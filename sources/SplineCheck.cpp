@@ -0,0 +1,211 @@
+#include "Spline.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+
+/**
+ * @brief Compares an edited spline with one built from scratch.
+ *
+ * The local updates of moveControlPoint, insertControlPoint,
+ * removeControlPoint and rebase must leave the spline exactly as a fresh
+ * build of its world control points at its origin would: the same local
+ * points, segments and bounds, the same arc lengths up to rounding, the same
+ * runs of visible segments and the same picking results.
+ *
+ * @param edited The spline after the edits.
+ * @param rng The source of the picking and view queries.
+ * @param what The kind of the last edit, printed with the differences.
+ * @return The number of differences found.
+ */
+static int compare(const Spline& edited, std::mt19937& rng,
+                   const char* what) {
+    Spline fresh(false);
+    const std::vector<dvec2>& world = edited.getWorldControlPoints();
+    fresh.assign(world.data(), edited.getKnots().data(), world.size(),
+                 nullptr, nullptr, edited.getOrigin());
+
+    const std::vector<CubicSegment>& a = edited.getSegments();
+    const std::vector<CubicSegment>& b = fresh.getSegments();
+    if (a.size() != b.size()) {
+        printf("%s: %zu segments instead of %zu\n", what, a.size(), b.size());
+        return 1;
+    }
+    int bad = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        const int s = static_cast<int>(i);
+        const WorldRect& x = edited.getSegmentBounds(s);
+        const WorldRect& y = fresh.getSegmentBounds(s);
+        if (a[i].a0 != b[i].a0 || a[i].a1 != b[i].a1 || a[i].a2 != b[i].a2 ||
+            a[i].a3 != b[i].a3 || x.min != y.min || x.max != y.max)
+            bad++;
+    }
+
+    const std::vector<double>& s = edited.getArcLengths();
+    const std::vector<double>& r = fresh.getArcLengths();
+    if (!a.empty() && s.size() != r.size())
+        bad++;
+    for (size_t k = 0; !a.empty() && k < s.size() && k < r.size(); k++)
+        if (fabs(s[k] - r[k]) > 1e-9 * (1.0 + r[k]))
+            bad++;
+
+    const std::vector<vec2>& points = edited.getControlPoints();
+    if (points != fresh.getControlPoints())
+        bad++;
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    std::vector<SegmentRange> runs, expected;
+    for (int q = 0; q < 100 && !points.empty(); q++) {
+        const vec2 p = points[rng() % points.size()] +
+                       vec2(offset(rng), offset(rng));
+
+        // Ties within the radius may pick either point, compare distances
+        const int i = edited.nearestControlPoint(p, 1.0f);
+        const int j = fresh.nearestControlPoint(p, 1.0f);
+        if ((i < 0) != (j < 0) ||
+            (i >= 0 && length(points[i] - p) != length(points[j] - p)))
+            bad++;
+
+        CurveHit h, g;
+        const bool hit = edited.closestPointOnCurve(p, 1.0f, h);
+        if (hit != fresh.closestPointOnCurve(p, 1.0f, g) ||
+            (hit && h.distance != g.distance))
+            bad++;
+
+        // Brute force over the segment bounds
+        const vec2 half(fabsf(offset(rng)), fabsf(offset(rng)));
+        const WorldRect view{p - half * 40.0f, p + half * 40.0f};
+        edited.visibleSegments(view, runs);
+        expected.clear();
+        for (int k = 0; k < static_cast<int>(a.size()); k++) {
+            if (!edited.getSegmentBounds(k).overlaps(view))
+                continue;
+            if (!expected.empty() && expected.back().last == k)
+                expected.back().last++;
+            else
+                expected.push_back({k, k + 1});
+        }
+        if (runs.size() != expected.size())
+            bad++;
+        for (size_t k = 0; k < runs.size() && k < expected.size(); k++)
+            if (runs[k].first != expected[k].first ||
+                runs[k].last != expected[k].last)
+                bad++;
+    }
+
+    if (bad > 0)
+        printf("%s: %d differences\n", what, bad);
+    return bad;
+}
+
+
+/**
+ * @brief Compares the shape of a track far from zero with the same track
+ * near zero.
+ *
+ * Only a0 may depend on where the track lies: the other coefficients are
+ * computed from differences of the world control points, see
+ * Spline::localSegment, so they must agree up to the rounding of a double at
+ * the far position, far below what float world positions would give.
+ *
+ * @param rng The source of the track.
+ * @return The number of segments whose shape differs.
+ */
+static int compareFar(std::mt19937& rng) {
+    std::uniform_real_distribution<double> offset(-1.0, 1.0);
+    const dvec2 far(3.0e7, -2.0e7);
+    std::vector<dvec2> near(200), shifted(200);
+    dvec2 p(0, 0);
+    for (size_t i = 0; i < near.size(); i++) {
+        p = p + dvec2(offset(rng) * 3.0 + 1.0, offset(rng) * 3.0);
+        near[i] = p;
+        shifted[i] = far + p;
+    }
+    std::vector<float> knots(near.size());
+    for (size_t i = 0; i < knots.size(); i++)
+        knots[i] = static_cast<float>(i);
+
+    Spline a(false), b(false);
+    a.assign(near.data(), knots.data(), near.size());
+    b.assign(shifted.data(), knots.data(), shifted.size());
+    b.rebase(Spline::rebaseOffset(b.evaluate(0.0)));
+    int bad = 0;
+    const auto matches = [](const vec2 x, const vec2 y) {
+        return length(x - y) <= 1e-5f * (1.0f + length(y));
+    };
+    for (size_t i = 0; i < a.getSegments().size(); i++) {
+        const CubicSegment& x = a.getSegments()[i];
+        const CubicSegment& y = b.getSegments()[i];
+        if (!matches(x.a1, y.a1) || !matches(x.a2, y.a2) ||
+            !matches(x.a3, y.a3))
+            bad++;
+    }
+    if (fabs(a.getLength() - b.getLength()) > 1e-6 * a.getLength())
+        bad++;
+    if (bad > 0)
+        printf("far: %d differences\n", bad);
+    return bad;
+}
+
+
+/**
+ * @brief Checks the local updates of the spline without a GL context.
+ *
+ * A random track is edited by random moves, insertions, removals and
+ * rebases by a whole tile, then shrunk to nothing and grown again, and after
+ * the edits it is compared with a spline built from scratch, see compare.
+ * A track far from zero is compared with the same track near it, see
+ * compareFar.
+ *
+ * @return 0 if every edited spline matched its fresh build, 1 otherwise.
+ */
+int main(const int argc, char* argv[]) {
+    const unsigned seed = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+    Spline spline(false);
+    vec2 p(0, 0);
+    for (int i = 0; i < 300; i++) {
+        p = p + vec2(offset(rng) * 3.0f + 1.0f, offset(rng) * 3.0f);
+        spline.addControlPoint(p);
+    }
+
+    int bad = 0;
+    static const char* const edits[] = {"move", "insert", "remove",
+                                        "rebase"};
+    for (int step = 0; step < 1000; step++) {
+        const int n = static_cast<int>(spline.getControlPoints().size());
+        const int edit = static_cast<int>(rng() % 4);
+        const int i = n > 0 ? static_cast<int>(rng() % n) : 0;
+        const vec2 cp = (n > 0 ? spline.getControlPoints()[i] : vec2(0, 0)) +
+                        vec2(offset(rng), offset(rng)) * 2.0f;
+        if (edit == 0 && n > 0)
+            spline.moveControlPoint(i, cp);
+        else if (edit == 1)
+            spline.insertControlPoint(static_cast<int>(rng() % (n + 1)), cp);
+        else if (edit == 2 && n > 0)
+            spline.removeControlPoint(i);
+        else if (edit == 3)
+            spline.rebase(vec2(static_cast<float>(rng() % 3) - 1.0f,
+                               static_cast<float>(rng() % 3) - 1.0f) *
+                          Spline::originTile);
+        if (step % 10 == 0)
+            bad += compare(spline, rng, edits[edit]);
+    }
+
+    while (!spline.getControlPoints().empty()) {
+        spline.removeControlPoint(
+            static_cast<int>(spline.getControlPoints().size() / 2));
+        bad += compare(spline, rng, "shrink");
+    }
+    for (int i = 0; i < 8; i++) {
+        spline.insertControlPoint(0, vec2(-i, offset(rng)));
+        bad += compare(spline, rng, "grow");
+    }
+
+    bad += compareFar(rng);
+
+    printf("%s: %d differences\n", bad > 0 ? "FAILED" : "passed", bad);
+    return bad > 0 ? 1 : 0;
+}
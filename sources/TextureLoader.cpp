@@ -0,0 +1,519 @@
+#include "TextureLoader.h"
+
+#include <cstring>
+
+
+// S3TC formats, from GL_EXT_texture_compression_s3tc and its sRGB variants
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#    define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#    define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#    define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#    define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#    define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#    define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#    define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#    define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+
+// Identifier and header of a KTX2 file, followed by the level index
+struct KTX2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat, typeSize;
+    uint32_t pixelWidth, pixelHeight, pixelDepth;
+    uint32_t layerCount, faceCount, levelCount, supercompressionScheme;
+    uint32_t dfdByteOffset, dfdByteLength, kvdByteOffset, kvdByteLength;
+    uint64_t sgdByteOffset, sgdByteLength;
+};
+
+static_assert(sizeof(KTX2Header) == 80);
+
+// Entry of the KTX2 level index, one per mip level from level 0 on
+struct KTX2Level {
+    uint64_t byteOffset, byteLength, uncompressedByteLength;
+};
+
+static constexpr uint8_t ktx2Identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// GL format of a Vulkan format a KTX2 file may use, with the bytes per 4x4
+// block, 0 for uncompressed RGBA8
+struct KTX2Format {
+    uint32_t vkFormat;
+    GLenum internalFormat;
+    unsigned blockBytes;
+};
+
+static constexpr KTX2Format ktx2Formats[] = {
+    {37, GL_RGBA8, 0},                                    // R8G8B8A8_UNORM
+    {43, GL_SRGB8_ALPHA8, 0},                             // R8G8B8A8_SRGB
+    {131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8},            // BC1_RGB_UNORM
+    {132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8},           // BC1_RGB_SRGB
+    {133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8},           // BC1_RGBA_UNORM
+    {134, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8},     // BC1_RGBA_SRGB
+    {135, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16},          // BC2_UNORM
+    {136, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16},    // BC2_SRGB
+    {137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16},          // BC3_UNORM
+    {138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16},    // BC3_SRGB
+    {139, GL_COMPRESSED_RED_RGTC1, 8},                    // BC4_UNORM
+    {140, GL_COMPRESSED_SIGNED_RED_RGTC1, 8},             // BC4_SNORM
+    {141, GL_COMPRESSED_RG_RGTC2, 16},                    // BC5_UNORM
+    {142, GL_COMPRESSED_SIGNED_RG_RGTC2, 16},             // BC5_SNORM
+    {143, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16},     // BC6H_UFLOAT
+    {144, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16},       // BC6H_SFLOAT
+    {145, GL_COMPRESSED_RGBA_BPTC_UNORM, 16},             // BC7_UNORM
+    {146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16}};      // BC7_SRGB
+
+
+/**
+ * @return The number of levels of a full mip chain of a width x height image.
+ */
+static int mipLevels(const int width, const int height) {
+    int levels = 1;
+    while ((std::max(width, height) >> levels) > 0)
+        levels++;
+    return levels;
+}
+
+
+/**
+ * @return The bytes of every level of an image.
+ */
+static size_t imageSize(const TextureImage& image) {
+    size_t size = 0;
+    for (const TextureLevel& level : image.levels)
+        size += level.size;
+    return size;
+}
+
+
+/**
+ * @brief Decodes a PNG file into RGBA8 texels.
+ *
+ * @param path The path of the file.
+ * @param transparent If set, the alpha of every texel is derived from its
+ * brightness, like the transparent textures of Texture.
+ * @param image Receives the texels as a single level.
+ * @return False if the file cannot be read or decoded.
+ */
+bool decodePNG(const std::string& path, const bool transparent,
+               TextureImage& image) {
+    unsigned char* pixels = nullptr;
+    unsigned width = 0, height = 0;
+    const unsigned error =
+        lodepng_decode32_file(&pixels, &width, &height, path.c_str());
+    if (error) {
+        fprintf(stderr, "Cannot decode %s: %s\n", path.c_str(),
+                lodepng_error_text(error));
+        free(pixels);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(width) * height * 4;
+    image.internalFormat = GL_RGBA8;
+    image.compressed = false;
+    image.data.assign(pixels, pixels + size);
+    free(pixels);
+    if (transparent)
+        for (size_t i = 0; i < size; i += 4)
+            image.data[i + 3] = static_cast<uint8_t>(
+                (image.data[i] + image.data[i + 1] + image.data[i + 2]) / 6);
+    image.levels = {{static_cast<int>(width), static_cast<int>(height), 0,
+                     size}};
+    return true;
+}
+
+
+/**
+ * @brief Reads a KTX2 file of a single 2D image.
+ *
+ * Only files without supercompression are read, RGBA8 or BC1 to BC7 encoded.
+ * The levels are validated against the size of the image but not decoded,
+ * they are uploaded as they are.
+ *
+ * @param path The path of the file.
+ * @param image Receives the whole file and the position of every level in it.
+ * @return False if the file cannot be read, is not a KTX2 file or uses a
+ * feature that is not supported.
+ */
+bool decodeKTX2(const std::string& path, TextureImage& image) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        fprintf(stderr, "Cannot open texture %s\n", path.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(data.data()),
+                   static_cast<std::streamsize>(data.size()))) {
+        fprintf(stderr, "Cannot read texture %s\n", path.c_str());
+        return false;
+    }
+
+    KTX2Header header;
+    if (data.size() < sizeof(header) ||
+        memcmp(data.data(), ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+        fprintf(stderr, "%s is not a KTX2 file\n", path.c_str());
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.supercompressionScheme != 0) {
+        fprintf(stderr, "Texture %s is supercompressed, which is not "
+                        "supported\n", path.c_str());
+        return false;
+    }
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 ||
+        header.pixelDepth > 0 || header.layerCount > 1 ||
+        header.faceCount != 1) {
+        fprintf(stderr, "Texture %s is not a single 2D image\n",
+                path.c_str());
+        return false;
+    }
+    const KTX2Format* format = nullptr;
+    for (const KTX2Format& candidate : ktx2Formats)
+        if (candidate.vkFormat == header.vkFormat)
+            format = &candidate;
+    if (!format) {
+        fprintf(stderr, "Texture %s has the unsupported format %u\n",
+                path.c_str(), header.vkFormat);
+        return false;
+    }
+
+    const int width = static_cast<int>(header.pixelWidth);
+    const int height = static_cast<int>(header.pixelHeight);
+    const uint32_t levelCount = std::max(header.levelCount, 1u);
+    if (header.pixelWidth > 1u << 16 || header.pixelHeight > 1u << 16 ||
+        levelCount > static_cast<uint32_t>(mipLevels(width, height)) ||
+        sizeof(header) + levelCount * sizeof(KTX2Level) > data.size()) {
+        fprintf(stderr, "Texture %s has an invalid level index\n",
+                path.c_str());
+        return false;
+    }
+
+    image.levels.clear();
+    for (uint32_t i = 0; i < levelCount; i++) {
+        KTX2Level level;
+        memcpy(&level, data.data() + sizeof(header) + i * sizeof(level),
+               sizeof(level));
+        const int w = std::max(width >> i, 1), h = std::max(height >> i, 1);
+        const size_t expected =
+            format->blockBytes
+                ? static_cast<size_t>((w + 3) / 4) * ((h + 3) / 4) *
+                      format->blockBytes
+                : static_cast<size_t>(w) * h * 4;
+        if (level.byteLength != expected || level.byteOffset > data.size() ||
+            level.byteLength > data.size() - level.byteOffset) {
+            fprintf(stderr, "Level %u of texture %s is truncated or has the "
+                            "wrong size\n", i, path.c_str());
+            return false;
+        }
+        image.levels.push_back({w, h, static_cast<size_t>(level.byteOffset),
+                                expected});
+    }
+    image.internalFormat = format->internalFormat;
+    image.compressed = format->blockBytes > 0;
+    image.data = std::move(data);
+    return true;
+}
+
+
+/**
+ * @brief Decodes a texture file, KTX2 by the extension .ktx2 and PNG
+ * otherwise.
+ *
+ * @param path The path of the file.
+ * @param transparent See decodePNG, ignored for KTX2 files.
+ * @param image Receives the decoded image.
+ * @return False if the file cannot be read or decoded.
+ */
+bool decodeTexture(const std::string& path, const bool transparent,
+                   TextureImage& image) {
+    if (fs::path(path).extension() == ".ktx2")
+        return decodeKTX2(path, image);
+    return decodePNG(path, transparent, image);
+}
+
+
+/**
+ * @brief Deletes the GL texture, on the thread owning the GL context.
+ */
+AsyncTexture::~AsyncTexture() {
+    if (textureId_ > 0)
+        glDeleteTextures(1, &textureId_);
+}
+
+
+/**
+ * @return True once the image is uploaded.
+ */
+bool AsyncTexture::isReady() const { return state_ == Ready; }
+
+
+/**
+ * @return True if the file could not be decoded or uploaded.
+ */
+bool AsyncTexture::hasFailed() const { return state_ == Failed; }
+
+
+/**
+ * @return The width of level 0, 0 before the upload.
+ */
+int AsyncTexture::getWidth() const { return width_; }
+
+
+/**
+ * @return The height of level 0, 0 before the upload.
+ */
+int AsyncTexture::getHeight() const { return height_; }
+
+
+/**
+ * @brief Binds the texture to a texture unit, or no texture before it is
+ * ready.
+ *
+ * @param textureUnit The index of the texture unit.
+ */
+void AsyncTexture::Bind(const int textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, textureId_);
+}
+
+
+/**
+ * @brief Starts the decoding thread.
+ */
+TextureLoader::TextureLoader() : worker_([this] { workerLoop(); }) {}
+
+
+/**
+ * @brief Stops the decoding thread and deletes the pixel unpack buffer.
+ *
+ * Requests that are not uploaded yet are dropped, their textures never
+ * become ready. Destroyed on the thread owning the GL context.
+ */
+TextureLoader::~TextureLoader() {
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+    if (pixelBuffer_ > 0)
+        glDeleteBuffers(1, &pixelBuffer_);
+}
+
+
+/**
+ * @brief Decodes the queued files one after the other until the loader
+ * stops.
+ */
+void TextureLoader::workerLoop() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (stopping_)
+            return;
+        std::unique_ptr<Request> request = std::move(pending_.front());
+        pending_.pop_front();
+
+        lock.unlock();
+        request->decoded = decodeTexture(
+            request->path, request->options.transparent, request->image);
+        lock.lock();
+        decoded_.push_back(std::move(request));
+    }
+}
+
+
+/**
+ * @brief Queues a texture file for decoding.
+ *
+ * Returns at once, the file is read on the decoding thread and uploaded by a
+ * later update.
+ *
+ * @param path The path of a PNG or KTX2 file, see decodeTexture.
+ * @param options How the texture is decoded and sampled.
+ * @return The texture, ready after the update that uploads it.
+ */
+std::shared_ptr<AsyncTexture>
+TextureLoader::load(const std::string& path, const TextureOptions& options) {
+    auto request = std::make_unique<Request>();
+    request->path = path;
+    request->options = options;
+    request->texture = std::make_shared<AsyncTexture>();
+    std::shared_ptr<AsyncTexture> texture = request->texture;
+    {
+        const std::lock_guard lock(mutex_);
+        pending_.push_back(std::move(request));
+    }
+    wake_.notify_one();
+    loading_++;
+    return texture;
+}
+
+
+/**
+ * @brief Checks whether the context supports a texture format.
+ *
+ * The formats other than S3TC are core in the GL 4.5 context of the
+ * application, S3TC needs GL_EXT_texture_compression_s3tc. The extensions
+ * are queried once.
+ *
+ * @param internalFormat The internal format of an image.
+ * @return False if textures of the format cannot be created.
+ */
+bool TextureLoader::isSupported(const GLenum internalFormat) {
+    const bool s3tc = (internalFormat >= GL_COMPRESSED_RGB_S3TC_DXT1_EXT &&
+                       internalFormat <= GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ||
+                      (internalFormat >= GL_COMPRESSED_SRGB_S3TC_DXT1_EXT &&
+                       internalFormat <=
+                           GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT);
+    if (!s3tc)
+        return true;
+    if (supportsS3TC_ < 0) {
+        supportsS3TC_ = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const auto* name = reinterpret_cast<const char*>(
+                glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                supportsS3TC_ = 1;
+        }
+    }
+    return supportsS3TC_ == 1;
+}
+
+
+/**
+ * @brief Uploads a decoded image into a new texture.
+ *
+ * The levels are copied into the pixel unpack buffer, whose previous storage
+ * is orphaned, and the texture levels are specified from it, so the driver
+ * transfers them without stalling on the copy. The texture gets immutable
+ * storage for all of its levels; an uncompressed single level image gets a
+ * full generated mip chain if mipmaps are requested.
+ *
+ * @param request A decoded request.
+ * @return False if the format is not supported or the buffer cannot be
+ * mapped.
+ */
+bool TextureLoader::upload(Request& request) {
+    const TextureImage& image = request.image;
+    if (!isSupported(image.internalFormat)) {
+        fprintf(stderr, "Texture %s: format 0x%x is not supported\n",
+                request.path.c_str(), image.internalFormat);
+        return false;
+    }
+
+    const size_t size = imageSize(image);
+    if (pixelBuffer_ == 0)
+        glGenBuffers(1, &pixelBuffer_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer_);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(size),
+                 nullptr, GL_STREAM_DRAW);
+    auto* mapped = static_cast<uint8_t*>(glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(size),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        fprintf(stderr, "Texture %s: cannot map the pixel buffer\n",
+                request.path.c_str());
+        return false;
+    }
+    std::vector<size_t> offsets;
+    size_t offset = 0;
+    for (const TextureLevel& level : image.levels) {
+        memcpy(mapped + offset, image.data.data() + level.offset, level.size);
+        offsets.push_back(offset);
+        offset += level.size;
+    }
+    if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        fprintf(stderr, "Texture %s: the pixel buffer was lost\n",
+                request.path.c_str());
+        return false;
+    }
+
+    const TextureLevel& base = image.levels.front();
+    const bool generate = request.options.mipmaps && !image.compressed &&
+                          image.levels.size() == 1;
+    const int levelCount = generate ? mipLevels(base.width, base.height)
+                                    : static_cast<int>(image.levels.size());
+    AsyncTexture& texture = *request.texture;
+    glGenTextures(1, &texture.textureId_);
+    glBindTexture(GL_TEXTURE_2D, texture.textureId_);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, image.internalFormat,
+                   base.width, base.height);
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const TextureLevel& level = image.levels[i];
+        const auto* pixels = reinterpret_cast<const void*>(offsets[i]);
+        if (image.compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0,
+                                      0, level.width, level.height,
+                                      image.internalFormat,
+                                      static_cast<GLsizei>(level.size),
+                                      pixels);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0, 0,
+                            level.width, level.height, GL_RGBA,
+                            GL_UNSIGNED_BYTE, pixels);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (generate)
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+    const int sampling = request.options.sampling;
+    const bool mipmapped = request.options.mipmaps && levelCount > 1;
+    const int minification = !mipmapped ? sampling
+                             : sampling == GL_NEAREST
+                                 ? GL_NEAREST_MIPMAP_NEAREST
+                                 : GL_LINEAR_MIPMAP_LINEAR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minification);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling);
+    texture.width_ = base.width;
+    texture.height_ = base.height;
+    return true;
+}
+
+
+/**
+ * @brief Uploads the decoded textures, on the thread owning the GL context.
+ *
+ * Called once per frame. Textures are uploaded in the order they were
+ * loaded until the uploaded bytes reach the budget, so at least one texture
+ * is uploaded per call while any is decoded and the rest wait for the next
+ * frames. A texture that failed to decode or upload is marked failed.
+ *
+ * @param uploadBudget The bytes after which no further texture is uploaded.
+ * @return The number of textures that became ready or failed.
+ */
+size_t TextureLoader::update(const size_t uploadBudget) {
+    const ProfileZone zone("TextureLoader::update");
+    size_t finished = 0, bytes = 0;
+    while (bytes < uploadBudget) {
+        std::unique_ptr<Request> request;
+        {
+            const std::lock_guard lock(mutex_);
+            if (decoded_.empty())
+                break;
+            request = std::move(decoded_.front());
+            decoded_.pop_front();
+        }
+        const bool uploaded = request->decoded && upload(*request);
+        request->texture->state_ =
+            uploaded ? AsyncTexture::Ready : AsyncTexture::Failed;
+        bytes += imageSize(request->image);
+        loading_--;
+        finished++;
+    }
+    return finished;
+}
+
+
+/**
+ * @return The number of loaded textures that are neither ready nor failed.
+ */
+size_t TextureLoader::loadingCount() const { return loading_; }
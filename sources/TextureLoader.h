@@ -0,0 +1,151 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include "Camera.h" // framework.h
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+// One mip level of a TextureImage, its bytes are data[offset, offset + size)
+struct TextureLevel {
+    int width, height;
+    size_t offset, size;
+};
+
+
+/**
+ * @struct TextureImage
+ * @brief A decoded image in the layout of its GL texture.
+ *
+ * Uncompressed images are RGBA8 texels, compressed ones BCn blocks for
+ * glCompressedTexSubImage2D. The levels are in order of decreasing size,
+ * level 0 first. They need not be contiguous: a KTX2 image keeps the whole
+ * file in data and its levels point into it.
+ */
+struct TextureImage {
+    GLenum internalFormat = GL_RGBA8;
+    bool compressed = false;
+    std::vector<uint8_t> data;
+    std::vector<TextureLevel> levels;
+};
+
+
+bool decodePNG(const std::string& path, bool transparent, TextureImage& image);
+
+bool decodeKTX2(const std::string& path, TextureImage& image);
+
+bool decodeTexture(const std::string& path, bool transparent,
+                   TextureImage& image);
+
+
+// How TextureLoader::load decodes and samples a texture
+struct TextureOptions {
+    bool transparent = false; // PNG alpha from the brightness, as in Texture
+    bool mipmaps = true;      // generated unless the file has its own levels
+    int sampling = GL_LINEAR; // GL_LINEAR or GL_NEAREST
+};
+
+
+/**
+ * @class AsyncTexture
+ * @brief A 2D texture whose image is decoded and uploaded by a TextureLoader.
+ *
+ * Until the upload the texture is not ready and Bind binds no texture, so
+ * the texture can be drawn with from the frame it is requested in.
+ */
+class AsyncTexture {
+    friend class TextureLoader;
+
+    enum State { Loading, Ready, Failed };
+
+    unsigned int textureId_ = 0;
+    State state_ = Loading;
+    int width_ = 0, height_ = 0;
+
+  public:
+    AsyncTexture() = default;
+
+    ~AsyncTexture();
+
+    AsyncTexture(const AsyncTexture&) = delete;
+    AsyncTexture& operator=(const AsyncTexture&) = delete;
+
+    bool isReady() const;
+
+    bool hasFailed() const;
+
+    int getWidth() const;
+
+    int getHeight() const;
+
+    void Bind(int textureUnit) const;
+};
+
+
+/**
+ * @class TextureLoader
+ * @brief Loads PNG and KTX2 textures without stalling the render thread.
+ *
+ * load only queues the file. A worker thread reads and decodes it, PNGs with
+ * lodepng and KTX2 files by validating their levels, so the render thread
+ * never waits for the disk or the decoder. update, called once per frame on
+ * the thread owning the GL context, uploads the decoded images through a
+ * pixel unpack buffer into immutable texture storage and generates the
+ * mipmaps. The uploads of one frame are limited by a byte budget, so a level
+ * switch loading many textures spreads them over a few frames instead of
+ * hitching. KTX2 files with BC1 to BC7 blocks are uploaded as they are,
+ * which skips decoding entirely and keeps them compressed in video memory,
+ * and supply their own mip levels.
+ */
+class TextureLoader {
+
+    struct Request {
+        std::string path;
+        TextureOptions options;
+        std::shared_ptr<AsyncTexture> texture;
+        TextureImage image;
+        bool decoded = false;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::unique_ptr<Request>> pending_; // guarded, to decode
+    std::deque<std::unique_ptr<Request>> decoded_; // guarded, to upload
+    bool stopping_ = false;                        // guarded
+
+    size_t loading_ = 0; // loaded and not uploaded yet, owner thread only
+    unsigned int pixelBuffer_ = 0;
+    int supportsS3TC_ = -1; // -1 until the extensions are queried
+
+    std::thread worker_; // last, it starts once the other members exist
+
+    void workerLoop();
+
+    bool isSupported(GLenum internalFormat);
+
+    bool upload(Request& request);
+
+  public:
+    static constexpr size_t defaultUploadBudget = 16 << 20; // bytes per frame
+
+    TextureLoader();
+
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    std::shared_ptr<AsyncTexture> load(const std::string& path,
+                                       const TextureOptions& options = {});
+
+    size_t update(size_t uploadBudget = defaultUploadBudget);
+
+    size_t loadingCount() const;
+};
+
+
+#endif // TEXTURELOADER_H
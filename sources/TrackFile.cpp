@@ -0,0 +1,478 @@
+#include "TrackFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+#ifdef _WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+
+/**
+ * @brief Unmaps the file.
+ */
+MappedFile::~MappedFile() { close(); }
+
+
+/**
+ * @brief Maps a whole file into memory for reading.
+ *
+ * An empty file is opened without a mapping, data() is nullptr then.
+ *
+ * @param path The path of the file.
+ * @return False if the file cannot be opened or mapped; the error is printed
+ * to stderr.
+ */
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+        file_ = nullptr;
+        fprintf(stderr, "Error while opening track file %s!\n", path.c_str());
+        return false;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0)
+        return true;
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ != nullptr)
+        data_ = static_cast<const uint8_t*>(
+            MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0)
+            ::close(fd);
+        fprintf(stderr, "Error while opening track file %s!\n", path.c_str());
+        return false;
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+            data_ = static_cast<const uint8_t*>(data);
+    }
+    ::close(fd); // the mapping keeps the file open
+    if (size_ == 0)
+        return true;
+#endif
+    if (data_ == nullptr) {
+        fprintf(stderr, "Error while mapping track file %s!\n", path.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Unmaps the file, if one is mapped.
+ */
+void MappedFile::close() {
+#ifdef _WIN32
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+    if (mapping_ != nullptr)
+        CloseHandle(mapping_);
+    if (file_ != nullptr)
+        CloseHandle(file_);
+    mapping_ = file_ = nullptr;
+#else
+    if (data_ != nullptr)
+        munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+
+/**
+ * @return The first byte of the mapped file.
+ */
+const uint8_t* MappedFile::data() const { return data_; }
+
+
+/**
+ * @return The size of the mapped file in bytes.
+ */
+size_t MappedFile::size() const { return size_; }
+
+
+// Byte offsets of the arrays of a binary track, see TrackHeader
+struct TrackLayout {
+    size_t points, knots, segments, arcLengths, end;
+};
+
+
+/**
+ * @brief Computes where the arrays of a binary track are stored.
+ *
+ * The header and the control points took fewer bytes before version 3, and
+ * the arc length entries before version 2, see TrackHeader.
+ *
+ * @param pointCount The number of control points.
+ * @param subdivisions The arc length entries per segment, 0 without the
+ * tables.
+ * @param version The version of the file.
+ * @return The offsets of the arrays and the size of the file.
+ */
+static TrackLayout trackLayout(const size_t pointCount,
+                               const size_t subdivisions,
+                               const uint32_t version = trackVersion) {
+    const auto align = [](const size_t offset) {
+        return (offset + trackAlignment - 1) / trackAlignment * trackAlignment;
+    };
+    const size_t headerSize =
+        version >= 3 ? sizeof(TrackHeader) : legacyTrackHeaderSize;
+    const size_t pointSize = version >= 3 ? sizeof(dvec2) : sizeof(vec2);
+    const size_t entrySize = version >= 2 ? sizeof(double) : sizeof(float);
+    const size_t segmentCount = pointCount < 2 ? 0 : pointCount - 1;
+    TrackLayout layout{};
+    layout.points = align(headerSize);
+    layout.knots = align(layout.points + pointCount * pointSize);
+    layout.end = layout.knots + pointCount * sizeof(float);
+    if (subdivisions > 0) {
+        layout.segments = align(layout.end);
+        layout.arcLengths =
+            align(layout.segments + segmentCount * sizeof(CubicSegment));
+        layout.end = layout.arcLengths +
+                     (segmentCount * subdivisions + 1) * entrySize;
+    }
+    return layout;
+}
+
+
+/**
+ * @brief Reads the control points of a track from a text file.
+ *
+ * Every line holds the x and y coordinates of one control point separated by
+ * whitespace. Empty lines and lines starting with '#' are skipped. The
+ * coordinates are read as doubles, the precision the spline keeps them in.
+ *
+ * @param path The path of the track file.
+ * @param points Receives the control points in file order, in world
+ * coordinates.
+ * @return False if the file cannot be opened or a line is malformed; the
+ * error is printed to stderr.
+ */
+bool readTextTrack(const std::string& path, std::vector<dvec2>& points) {
+    points.clear();
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Error while opening track file %s!\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::istringstream fields(line);
+        dvec2 p;
+        std::string rest;
+        if (!(fields >> p.x >> p.y) || fields >> rest) {
+            fprintf(stderr, "Malformed control point in %s, line %d\n",
+                    path.c_str(), number);
+            return false;
+        }
+        points.push_back(p);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Adds an array of a binary track to a checksum, see TrackHeader.
+ *
+ * FNV-1a over 64-bit words with a shift folding the high bits down, the
+ * last partial word padded with zeros. It detects a file damaged or cut
+ * after it was written, not a deliberate change.
+ *
+ * @param hash The checksum of the arrays before, trackChecksumSeed for the
+ * first one.
+ * @param data The array.
+ * @param size The bytes of the array.
+ * @return The checksum including the array.
+ */
+static uint64_t addChecksum(uint64_t hash, const void* data,
+                            const size_t size) {
+    const auto mix = [&hash](const uint64_t word) {
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    };
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        mix(word);
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, size - i);
+        mix(word);
+    }
+    return hash;
+}
+
+
+/**
+ * @brief Locates the arrays of a binary track in a mapped file.
+ *
+ * Nothing is parsed or copied: the header and the sizes are validated and
+ * the views point into the mapping, so they are only valid while the file
+ * stays mapped. The arrays of a version 3 file are read once to verify the
+ * checksum of the header, which is all the checking the tables get: they
+ * are used exactly as writeBinaryTrack stored them from a Spline, without
+ * recomputing any coefficient or arc length. The knots must be 0, 1, 2, ...
+ * like the ones of Spline::addControlPoint, for at most
+ * Spline::maxControlPoints points. Tables stored with a different number of
+ * arc length subdivisions than Spline::arcLengthSubdivisions and the tables
+ * of versions before 3, which were computed from float points, are ignored,
+ * so the spline computes its own. The points of versions before 3 are
+ * float, see TrackView::legacyPoints.
+ *
+ * @param file The mapped track file.
+ * @param track Receives the views of the arrays.
+ * @return False if the file is not a valid binary track of a supported
+ * version; the error is printed to stderr.
+ */
+bool readBinaryTrack(const MappedFile& file, TrackView& track) {
+    track = TrackView{};
+    TrackHeader header{};
+    if (file.size() < legacyTrackHeaderSize) {
+        fprintf(stderr, "Truncated binary track\n");
+        return false;
+    }
+    std::memcpy(&header, file.data(), legacyTrackHeaderSize);
+    if (std::memcmp(header.magic, "GTRK", 4) != 0 ||
+        header.version < 1 || header.version > trackVersion ||
+        (header.flags & ~uint32_t{TrackHasTables}) != 0) {
+        fprintf(stderr, "Unsupported binary track version %u\n",
+                header.version);
+        return false;
+    }
+    const bool current = header.version == trackVersion;
+    if (current) {
+        if (file.size() < sizeof(header)) {
+            fprintf(stderr, "Truncated binary track\n");
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+    } else {
+        header.originX = header.originY = 0.0; // the reserved field before
+    }
+
+    const bool tables = (header.flags & TrackHasTables) != 0;
+    // Every point takes at least 12 bytes, which bounds the count before
+    // the layout is computed from it
+    if (header.pointCount > file.size() / 12 ||
+        header.pointCount > Spline::maxControlPoints ||
+        (tables && header.subdivisions == 0) ||
+        !std::isfinite(header.originX) || !std::isfinite(header.originY)) {
+        fprintf(stderr, "Corrupt binary track header\n");
+        return false;
+    }
+    const size_t count = static_cast<size_t>(header.pointCount);
+    const TrackLayout layout = trackLayout(
+        count, tables ? header.subdivisions : 0, header.version);
+    if (layout.end > file.size()) {
+        fprintf(stderr, "Truncated binary track\n");
+        return false;
+    }
+
+    const uint8_t* data = file.data();
+    if (current) {
+        const size_t segmentCount = count < 2 ? 0 : count - 1;
+        uint64_t hash = trackChecksumSeed;
+        hash = addChecksum(hash, data + layout.points, count * sizeof(dvec2));
+        hash = addChecksum(hash, data + layout.knots, count * sizeof(float));
+        if (tables) {
+            hash = addChecksum(hash, data + layout.segments,
+                               segmentCount * sizeof(CubicSegment));
+            hash = addChecksum(hash, data + layout.arcLengths,
+                               layout.end - layout.arcLengths);
+        }
+        if (hash != header.checksum) {
+            fprintf(stderr, "Corrupt binary track, checksum mismatch\n");
+            return false;
+        }
+    }
+    track.pointCount = count;
+    track.origin = dvec2(header.originX, header.originY);
+    if (current)
+        track.points = reinterpret_cast<const dvec2*>(data + layout.points);
+    else
+        track.legacyPoints =
+            reinterpret_cast<const vec2*>(data + layout.points);
+    track.knots = reinterpret_cast<const float*>(data + layout.knots);
+    for (size_t i = 0; i < count; i++) {
+        if (track.knots[i] != static_cast<float>(i)) {
+            fprintf(stderr, "Binary track has non-uniform knots\n");
+            track = TrackView{};
+            return false;
+        }
+    }
+    if (tables && current &&
+        header.subdivisions == Spline::arcLengthSubdivisions) {
+        track.segments =
+            reinterpret_cast<const CubicSegment*>(data + layout.segments);
+        track.arcLengths =
+            reinterpret_cast<const double*>(data + layout.arcLengths);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Writes the control points of a spline as a binary track.
+ *
+ * @param path The path of the track file.
+ * @param spline The spline to store. Its control points are written in world
+ * coordinates, its segments relative to its origin, which is stored in the
+ * header, see Spline::rebase.
+ * @param withTables True to store the segment coefficients and the arc length
+ * table as well, which spares computing them when loading. Splines with
+ * fewer than two control points have no tables.
+ * @return False if the file cannot be written; the error is printed to
+ * stderr.
+ */
+bool writeBinaryTrack(const std::string& path, const Spline& spline,
+                      const bool withTables) {
+    const std::vector<dvec2>& points = spline.getWorldControlPoints();
+    const bool tables = withTables && points.size() >= 2;
+    const size_t subdivisions = tables ? Spline::arcLengthSubdivisions : 0;
+    const TrackLayout layout = trackLayout(points.size(), subdivisions);
+
+    TrackHeader header{};
+    std::memcpy(header.magic, "GTRK", 4);
+    header.version = trackVersion;
+    header.flags = tables ? uint32_t{TrackHasTables} : 0;
+    header.subdivisions = static_cast<uint32_t>(subdivisions);
+    header.pointCount = points.size();
+    header.originX = spline.getOrigin().x;
+    header.originY = spline.getOrigin().y;
+    const std::vector<CubicSegment>& segments = spline.getSegments();
+    const std::vector<double>& arcLengths = spline.getArcLengths();
+    header.checksum = addChecksum(trackChecksumSeed, points.data(),
+                                  points.size() * sizeof(dvec2));
+    header.checksum =
+        addChecksum(header.checksum, spline.getKnots().data(),
+                    points.size() * sizeof(float));
+    if (tables) {
+        header.checksum =
+            addChecksum(header.checksum, segments.data(),
+                        segments.size() * sizeof(CubicSegment));
+        header.checksum =
+            addChecksum(header.checksum, arcLengths.data(),
+                        arcLengths.size() * sizeof(double));
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    const auto writeAt = [&file](const size_t offset, const void* data,
+                                 const size_t bytes) {
+        static const char padding[trackAlignment] = {};
+        const size_t position = static_cast<size_t>(file.tellp());
+        file.write(padding, static_cast<std::streamsize>(offset - position));
+        file.write(static_cast<const char*>(data),
+                   static_cast<std::streamsize>(bytes));
+    };
+    writeAt(0, &header, sizeof(header));
+    writeAt(layout.points, points.data(), points.size() * sizeof(dvec2));
+    writeAt(layout.knots, spline.getKnots().data(),
+            points.size() * sizeof(float));
+    if (tables) {
+        writeAt(layout.segments, segments.data(),
+                segments.size() * sizeof(CubicSegment));
+        writeAt(layout.arcLengths, arcLengths.data(),
+                arcLengths.size() * sizeof(double));
+    }
+    if (!file) {
+        fprintf(stderr, "Error while writing track file %s!\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Computes the local origin of a track loaded without one.
+ *
+ * The same rule as Spline::rebaseOffset applied to the start of the track,
+ * where the gondolas start, so tracks starting near zero keep origin zero.
+ *
+ * @param points The control points in world coordinates.
+ * @return The whole Spline::originTile nearest to the first point, or zero.
+ */
+static dvec2 startOrigin(const std::vector<dvec2>& points) {
+    if (points.empty())
+        return dvec2(0, 0);
+    const dvec2 p = points.front();
+    if (!(std::max(std::fabs(p.x), std::fabs(p.y)) > Spline::rebaseDistance))
+        return dvec2(0, 0);
+    const double tile = Spline::originTile;
+    return dvec2(std::round(p.x / tile), std::round(p.y / tile)) * tile;
+}
+
+
+/**
+ * @brief Loads a track file into a spline, replacing its control points.
+ *
+ * Binary tracks are recognized by their magic number and used straight from
+ * the mapped file: Spline::assign copies each array once, so loading is
+ * bound by reading the pages rather than by parsing, and the spline takes the
+ * origin stored in the header. Any other file is read as a text track. Text
+ * tracks and the float points of older binary tracks are converted to
+ * double, and their origin is the tile of their start, see startOrigin.
+ *
+ * @param path The path of the binary or text track file.
+ * @param spline The spline receiving the track.
+ * @return False if the track cannot be read; the error is printed to stderr.
+ */
+bool loadTrack(const std::string& path, Spline& spline) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    std::vector<dvec2> points;
+    if (file.size() >= 4 && std::memcmp(file.data(), "GTRK", 4) == 0) {
+        TrackView track;
+        if (!readBinaryTrack(file, track)) {
+            fprintf(stderr, "Cannot load binary track %s\n", path.c_str());
+            return false;
+        }
+        if (track.points != nullptr) {
+            spline.assign(track.points, track.knots, track.pointCount,
+                          track.segments, track.arcLengths, track.origin);
+            return true;
+        }
+        points.resize(track.pointCount);
+        for (size_t i = 0; i < track.pointCount; i++)
+            points[i] = dvec2(track.legacyPoints[i]);
+    } else {
+        file.close();
+        if (!readTextTrack(path, points))
+            return false;
+    }
+
+    std::vector<float> knots(points.size());
+    std::iota(knots.begin(), knots.end(), 0.0f);
+    spline.assign(points.data(), knots.data(), points.size(), nullptr,
+                  nullptr, startOrigin(points));
+    return true;
+}
@@ -0,0 +1,103 @@
+#ifndef TRACKFILE_H
+#define TRACKFILE_H
+
+#include "Spline.h"
+
+#include <cstdint>
+
+
+/**
+ * @struct TrackHeader
+ * @brief Header of a binary track file.
+ *
+ * The header is followed by the arrays it describes, each starting at a
+ * multiple of trackAlignment bytes: the control points in world coordinates
+ * as dvec2, the knots as float and, with TrackHasTables, the CubicSegment
+ * coefficients of the pointCount - 1 segments, relative to the world
+ * position originX, originY, and the cumulative arc length table of
+ * subdivisions entries per segment plus a leading zero, as double. All values
+ * are little-endian, in the memory layout of the Spline tables, so the arrays
+ * are used straight from the mapped file. The checksum covers the arrays,
+ * see readBinaryTrack. Version 1 and 2 files have a header of
+ * legacyTrackHeaderSize bytes without the origin or the checksum and store
+ * the control points as vec2, and version 1 files stored the arc length
+ * table as float; their tables are ignored when loading.
+ */
+struct TrackHeader {
+    char magic[4];         // "GTRK"
+    uint32_t version;      // trackVersion
+    uint32_t flags;        // TrackFlags
+    uint32_t subdivisions; // arc length entries per segment
+    uint64_t pointCount;
+    double originX;        // world position the segments are relative to
+    double originY;
+    uint64_t checksum;     // of the arrays, from trackChecksumSeed on
+};
+
+static_assert(sizeof(TrackHeader) == 48);
+
+inline constexpr uint32_t trackVersion = 3;
+inline constexpr size_t legacyTrackHeaderSize = 32;
+inline constexpr size_t trackAlignment = 16;
+inline constexpr uint64_t trackChecksumSeed = 0xcbf29ce484222325ull;
+
+enum TrackFlags : uint32_t { TrackHasTables = 1 };
+
+
+/**
+ * @class MappedFile
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * Uses mmap on POSIX systems and a file mapping object on Windows. The pages
+ * are only read from disk when they are first touched.
+ */
+class MappedFile {
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+
+  public:
+    MappedFile() = default;
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+
+    void close();
+
+    const uint8_t* data() const;
+
+    size_t size() const;
+};
+
+
+// Arrays of a binary track inside a MappedFile, see readBinaryTrack
+struct TrackView {
+    const dvec2* points = nullptr;      // world coordinates
+    const vec2* legacyPoints = nullptr; // instead of points before version 3
+    const float* knots = nullptr;
+    size_t pointCount = 0;
+    const CubicSegment* segments = nullptr; // nullptr without the tables
+    const double* arcLengths = nullptr;
+    dvec2 origin{0, 0}; // world position the segments are relative to
+};
+
+
+bool readTextTrack(const std::string& path, std::vector<dvec2>& points);
+
+bool readBinaryTrack(const MappedFile& file, TrackView& track);
+
+bool writeBinaryTrack(const std::string& path, const Spline& spline,
+                      bool withTables = true);
+
+bool loadTrack(const std::string& path, Spline& spline);
+
+
+#endif // TRACKFILE_H
@@ -0,0 +1,187 @@
+#include "ViewSet.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+/**
+ * @brief Constructs an empty set of views.
+ *
+ * @param windowSize The size of the window the viewports are part of, in
+ * pixels.
+ */
+ViewSet::ViewSet(const vec2 windowSize) : windowSize_(windowSize) {}
+
+
+/**
+ * @brief Releases the uniform buffer of the view blocks.
+ */
+ViewSet::~ViewSet() {
+    if (buffer_ != 0)
+        glDeleteBuffers(1, &buffer_);
+}
+
+
+/**
+ * @brief Adds a view, drawn after the views added before it.
+ *
+ * Later views are drawn over the earlier ones, so a small viewport added last
+ * is an inset of a larger one.
+ *
+ * @param camera The camera of the view.
+ * @param viewport The part of the window the view is drawn into.
+ * @return The index of the new view.
+ */
+size_t ViewSet::add(const Camera& camera, const Viewport& viewport) {
+    views_.push_back({camera, viewport});
+    return views_.size() - 1;
+}
+
+
+/**
+ * @brief Removes a view; the views after it move down by one index.
+ *
+ * @param i The index of the view.
+ */
+void ViewSet::remove(const size_t i) { views_.erase(views_.begin() + i); }
+
+
+/**
+ * @return The number of views.
+ */
+size_t ViewSet::size() const { return views_.size(); }
+
+
+/**
+ * @param i The index of the view.
+ * @return The camera of view i, e.g. to move it before the next upload.
+ */
+Camera& ViewSet::getCamera(const size_t i) { return views_[i].camera; }
+
+
+/**
+ * @param i The index of the view.
+ * @return The camera of view i.
+ */
+const Camera& ViewSet::getCamera(const size_t i) const {
+    return views_[i].camera;
+}
+
+
+/**
+ * @param i The index of the view.
+ * @return The part of the window view i is drawn into.
+ */
+const Viewport& ViewSet::getViewport(const size_t i) const {
+    return views_[i].viewport;
+}
+
+
+/**
+ * @brief Finds the view drawn at a pixel of the window.
+ *
+ * @param pX The x-coordinate in window pixels.
+ * @param pY The y-coordinate in window pixels.
+ * @return The index of the topmost view containing the pixel, -1 if there is
+ * none.
+ */
+int ViewSet::viewAt(const int pX, const int pY) const {
+    for (int i = static_cast<int>(views_.size()) - 1; i >= 0; i--)
+        if (views_[i].viewport.contains(pX, pY))
+            return i;
+    return -1;
+}
+
+
+/**
+ * @brief Converts a pixel of the window to world coordinates through view i.
+ *
+ * @param i The index of the view.
+ * @param pX The x-coordinate in window pixels.
+ * @param pY The y-coordinate in window pixels.
+ * @return The world position seen at the pixel, see Camera::pixelToWorld.
+ */
+vec2 ViewSet::pixelToWorld(const size_t i, const int pX, const int pY) const {
+    const View& view = views_[i];
+    return view.camera.pixelToWorld(
+        vec2(pX - view.viewport.x, pY - view.viewport.y),
+        view.viewport.size());
+}
+
+
+/**
+ * @param i The index of the view.
+ * @return The size of a pixel of view i in world units, see
+ * Camera::pixelSize.
+ */
+float ViewSet::pixelSize(const size_t i) const {
+    return views_[i].camera.pixelSize(views_[i].viewport.size());
+}
+
+
+/**
+ * @brief Gets the world rectangle seen by view i, to cull the scene against.
+ *
+ * @param i The index of the view.
+ * @param marginPixels The margin added on every side, in pixels of the view,
+ * e.g. for the line width and point size.
+ * @return The expanded rectangle of the camera of view i.
+ */
+WorldRect ViewSet::worldRect(const size_t i, const float marginPixels) const {
+    return views_[i].camera.worldRect().expanded(marginPixels * pixelSize(i));
+}
+
+
+/**
+ * @brief Writes the ViewBlock of every view to the uniform buffer.
+ *
+ * Called once per frame, after the cameras moved and before the first bind.
+ * The buffer is reallocated, and thereby orphaned, on every upload, so the
+ * blocks of the previous frame may still be read by the GPU.
+ */
+void ViewSet::upload() {
+    if (buffer_ == 0) {
+        glCreateBuffers(1, &buffer_);
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        const size_t align = std::max<size_t>(alignment, 1);
+        stride_ = (sizeof(ViewBlock) + align - 1) / align * align;
+    }
+    std::vector<uint8_t> blocks(std::max<size_t>(views_.size(), 1) * stride_);
+    for (size_t i = 0; i < views_.size(); i++) {
+        const ViewBlock block{views_[i].camera.viewProjectionMatrix()};
+        std::memcpy(blocks.data() + i * stride_, &block, sizeof(block));
+    }
+    glNamedBufferData(buffer_, static_cast<GLsizeiptr>(blocks.size()),
+                      blocks.data(), GL_STREAM_DRAW);
+}
+
+
+/**
+ * @brief Draws the following draw calls through view i.
+ *
+ * Binds the block of view i to viewBinding and limits the viewport and the
+ * scissor rectangle to the view, so a glClear only clears the view.
+ *
+ * @param i The index of the view.
+ */
+void ViewSet::bind(const size_t i) const {
+    const Viewport& viewport = views_[i].viewport;
+    const int y = static_cast<int>(windowSize_.y) - viewport.y -
+                  viewport.height; // GL counts from the bottom
+    glViewport(viewport.x, y, viewport.width, viewport.height);
+    glScissor(viewport.x, y, viewport.width, viewport.height);
+    glEnable(GL_SCISSOR_TEST);
+    glBindBufferRange(GL_UNIFORM_BUFFER, viewBinding, buffer_,
+                      static_cast<GLintptr>(i * stride_), sizeof(ViewBlock));
+}
+
+
+/**
+ * @brief Restores the viewport of the whole window after the views.
+ */
+void ViewSet::unbind() const {
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(0, 0, static_cast<int>(windowSize_.x),
+               static_cast<int>(windowSize_.y));
+}
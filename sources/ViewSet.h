@@ -0,0 +1,89 @@
+#ifndef VIEWSET_H
+#define VIEWSET_H
+
+#include "Camera.h"
+
+
+// Part of the window a view is drawn into, in pixels from the top left
+// corner like the mouse positions
+struct Viewport {
+    int x, y, width, height;
+
+    bool contains(const int pX, const int pY) const {
+        return pX >= x && pX < x + width && pY >= y && pY < y + height;
+    }
+
+    vec2 size() const { return vec2(width, height); }
+};
+
+
+// std140 layout of the View uniform block of the shaders, see ViewSet
+struct ViewBlock {
+    mat4 MVP;
+};
+
+
+/**
+ * @class ViewSet
+ * @brief The cameras of one scene drawn into several viewports of a window.
+ *
+ * upload writes the ViewBlock of every view into one uniform buffer, once per
+ * frame, each at a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT. bind
+ * selects the viewport of a view and binds its block to viewBinding, so every
+ * program reading its View block from there (see
+ * GPUProgram::bindUniformBlock) draws through the camera of the view without
+ * a uniform being set. Nothing else differs between the views: the buffers of
+ * the scene are shared, and each view only culls them against its own world
+ * rectangle.
+ */
+class ViewSet {
+
+    struct View {
+        Camera camera;
+        Viewport viewport;
+    };
+
+    std::vector<View> views_;
+    vec2 windowSize_;
+    unsigned int buffer_ = 0;
+    size_t stride_ = 0; // bytes between the blocks of two views
+
+  public:
+    static constexpr unsigned int viewBinding = 0;
+
+    explicit ViewSet(vec2 windowSize);
+
+    ~ViewSet();
+
+    ViewSet(const ViewSet&) = delete;
+    ViewSet& operator=(const ViewSet&) = delete;
+
+    size_t add(const Camera& camera, const Viewport& viewport);
+
+    void remove(size_t i);
+
+    size_t size() const;
+
+    Camera& getCamera(size_t i);
+
+    const Camera& getCamera(size_t i) const;
+
+    const Viewport& getViewport(size_t i) const;
+
+    int viewAt(int pX, int pY) const;
+
+    vec2 pixelToWorld(size_t i, int pX, int pY) const;
+
+    float pixelSize(size_t i) const;
+
+    WorldRect worldRect(size_t i, float marginPixels = 0.0f) const;
+
+    void upload();
+
+    void bind(size_t i) const;
+
+    void unbind() const;
+};
+
+
+#endif // VIEWSET_H
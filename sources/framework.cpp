@@ -12,6 +12,9 @@ static const char* windowCaption = "Grafika";
 static GLFWwindow* window;
 static bool screenRefresh = true;
 static glApp* pApp = nullptr;
+static double fixedTimeStep = 0; // 0: one variable interval per frame
+static int maxSubsteps = 10;
+static float renderAlpha = 1.0f;
 
 // Esem�nykezel�k
 static void error_callback(int error, const char* description) {
@@ -84,6 +87,15 @@ glApp::glApp(const char* _windowCaption) {
 // Rajzold �jra az alkalmaz�si ablakot
 void glApp::refreshScreen() { screenRefresh = true; }
 
+// Fixed step physics, see glApp::setFixedTimeStep
+void glApp::setFixedTimeStep(const float dt, const int _maxSubsteps) {
+    fixedTimeStep = dt > 0 ? dt : 0;
+    maxSubsteps = _maxSubsteps > 0 ? _maxSubsteps : 1;
+    renderAlpha = fixedTimeStep > 0 ? 0.0f : 1.0f;
+}
+
+float glApp::interpolationAlpha() const { return renderAlpha; }
+
 // Lek�rdez�ses klaviat�ra kezel�s
 bool pollKey(const int key) { return (glfwGetKey(window, key) == GLFW_PRESS); }
 
@@ -118,22 +130,45 @@ int main(void) {
 
     // Applik�ci� inicializ�l�sa
     pApp->onInitialization();
-    float startTime = 0;
+    double startTime = 0, accumulator = 0;
 
     // �zenetkezel� hurok
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents(); // esem�nyek lek�rdez�se �s reakci�
+        if (screenRefresh || pApp->isAnimating()) {
+            glfwPollEvents(); // esem�nyek lek�rdez�se �s reakci�
+        } else {
+            glfwWaitEvents(); // idle: sleep until the next event
+            startTime = glfwGetTime();
+            accumulator = 0; // the idle time is not simulated
+        }
 
-        const float endTime =
-            static_cast<float>(glfwGetTime());   // id� lek�rdez�se
-        pApp->onTimeElapsed(startTime, endTime); // anim�ci�
+        Profiler::get().beginFrame();
+        const double endTime = glfwGetTime(); // id� lek�rdez�se
+        if (fixedTimeStep > 0) {
+            accumulator += endTime - startTime;
+            for (int i = 0; i < maxSubsteps && accumulator >= fixedTimeStep;
+                 i++) {
+                pApp->onFixedStep(static_cast<float>(fixedTimeStep));
+                accumulator -= fixedTimeStep;
+            }
+            if (accumulator >= fixedTimeStep) // too far behind: drop the rest
+                accumulator = fmod(accumulator, fixedTimeStep);
+            renderAlpha = static_cast<float>(accumulator / fixedTimeStep);
+        } else {
+            pApp->onTimeElapsed(static_cast<float>(startTime),
+                                static_cast<float>(endTime)); // anim�ci�
+        }
         startTime = endTime;
 
         if (screenRefresh) {
-            pApp->onDisplay();       // rajzol�s
-            glfwSwapBuffers(window); // buffercsere
+            pApp->onDisplay(); // rajzol�s
+            {
+                ProfileZone zone("glfwSwapBuffers"); // waits for vsync
+                glfwSwapBuffers(window);             // buffercsere
+            }
             screenRefresh = false;
         }
+        Profiler::get().endFrame();
     }
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -7,10 +7,16 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #define FILE_OPERATIONS
@@ -34,11 +40,37 @@ inline mat4 rotate(const float angle, const vec3& v) {
     return rotate(mat4(1.0f), angle, v);
 }
 
+// Color with components in [0, 1] as opaque RGBA8, for per-vertex and
+// per-instance color attributes
+inline uint32_t packColor(const vec3 color) {
+    const auto channel = [](const float c) {
+        return static_cast<uint32_t>(clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+    };
+    return channel(color.x) | channel(color.y) << 8 | channel(color.z) << 16 |
+           0xFF000000u;
+}
+
+// Location of a uniform in one GPUProgram, looked up once with
+// GPUProgram::uniform and then set without any string work. Negative if the
+// program has no such active uniform.
+struct UniformHandle {
+    int location = -1;
+};
+
 //---------------------------
 class GPUProgram {
     //--------------------------
+    // Transparent hash: lookups with a string_view allocate nothing
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(const std::string_view name) const {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
     GLuint shaderProgramId = 0;
     bool waitError = true;
+    std::unordered_map<std::string, int, NameHash, std::equal_to<>> locations;
 
     bool checkShader(const unsigned int shader,
                      std::string message) { // shader ford�t�si hib�k kezel�se
@@ -75,13 +107,42 @@ class GPUProgram {
         return true;
     }
 
+    // Caches the locations of every active uniform after linking. Arrays are
+    // also registered without their "[0]" suffix.
+    void cacheLocations() {
+        locations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORM_MAX_LENGTH,
+                       &maxLength);
+        std::string name(std::max(maxLength, 1), '\0');
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(shaderProgramId, i, maxLength, &length, &size,
+                               &type, name.data());
+            const std::string uniformName = name.substr(0, length);
+            const int location =
+                glGetUniformLocation(shaderProgramId, uniformName.c_str());
+            if (location < 0)
+                continue; // uniform block member
+            locations[uniformName] = location;
+            if (uniformName.ends_with("[0]"))
+                locations[uniformName.substr(0, uniformName.size() - 3)] =
+                    location;
+        }
+    }
+
     int getLocation(
-        const std::string& name) { // uniform v�ltoz� c�m�nek lek�rdez�se
-        const int location =
-            glGetUniformLocation(shaderProgramId, name.c_str());
-        if (location < 0)
-            printf("uniform %s cannot be set\n", name.c_str());
-        return location;
+        const std::string_view name) { // uniform v�ltoz� c�m�nek lek�rdez�se
+        const auto it = locations.find(name);
+        if (it != locations.end())
+            return it->second;
+        printf("uniform %.*s cannot be set\n", static_cast<int>(name.size()),
+               name.data());
+        locations.emplace(name, -1); // report a missing uniform only once
+        return -1;
     }
 
 #ifdef FILE_OPERATIONS
@@ -198,6 +259,30 @@ class GPUProgram {
         glUseProgram(shaderProgramId);
     }
 
+    // Program of a single compute shader, run with glDispatchCompute
+    void createCompute(const char* const computeShaderSource) {
+        const GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
+        if (!computeShader) {
+            printf("Error in compute shader creation\n");
+            exit(1);
+        }
+        glShaderSource(computeShader, 1, (const GLchar**)&computeShaderSource,
+                       NULL);
+        glCompileShader(computeShader);
+        if (!checkShader(computeShader, "Compute shader error"))
+            return;
+
+        shaderProgramId = glCreateProgram();
+        if (!shaderProgramId) {
+            printf("Error in shader program creation\n");
+            exit(-1);
+        }
+        glAttachShader(shaderProgramId, computeShader);
+        if (!link())
+            return;
+        glUseProgram(shaderProgramId);
+    }
+
 #ifdef FILE_OPERATIONS
     bool addShader(const fs::path& _fileName) {
         GLenum shaderType = 0;
@@ -244,45 +329,82 @@ class GPUProgram {
 
     bool link() {
         glLinkProgram(shaderProgramId);
-        return checkLinking(shaderProgramId);
+        if (!checkLinking(shaderProgramId))
+            return false;
+        cacheLocations();
+        return true;
     }
 
     void Use() { glUseProgram(shaderProgramId); } // make this program run
 
-    void setUniform(const int i, const std::string& name) {
-        const int location = getLocation(name);
-        if (location >= 0)
-            glUniform1i(location, i);
+    UniformHandle uniform(const std::string_view name) {
+        return UniformHandle{getLocation(name)};
+    }
+
+    void setUniform(const int i, const UniformHandle handle) {
+        if (handle.location >= 0)
+            glUniform1i(handle.location, i);
+    }
+
+    void setUniform(const float f, const UniformHandle handle) {
+        if (handle.location >= 0)
+            glUniform1f(handle.location, f);
+    }
+
+    void setUniform(const vec2& v, const UniformHandle handle) {
+        if (handle.location >= 0)
+            glUniform2fv(handle.location, 1, &v.x);
+    }
+
+    void setUniform(const vec3& v, const UniformHandle handle) {
+        if (handle.location >= 0)
+            glUniform3fv(handle.location, 1, &v.x);
     }
 
-    void setUniform(const float f, const std::string& name) {
-        const int location = getLocation(name);
-        if (location >= 0)
-            glUniform1f(location, f);
+    void setUniform(const vec4& v, const UniformHandle handle) {
+        if (handle.location >= 0)
+            glUniform4fv(handle.location, 1, &v.x);
     }
 
-    void setUniform(const vec2& v, const std::string& name) {
-        const int location = getLocation(name);
-        if (location >= 0)
-            glUniform2fv(location, 1, &v.x);
+    void setUniform(const mat4& mat, const UniformHandle handle) {
+        if (handle.location >= 0)
+            glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
 
-    void setUniform(const vec3& v, const std::string& name) {
-        const int location = getLocation(name);
-        if (location >= 0)
-            glUniform3fv(location, 1, &v.x);
+    void setUniform(const int i, const std::string_view name) {
+        setUniform(i, uniform(name));
     }
 
-    void setUniform(const vec4& v, const std::string& name) {
-        const int location = getLocation(name);
-        if (location >= 0)
-            glUniform4fv(location, 1, &v.x);
+    void setUniform(const float f, const std::string_view name) {
+        setUniform(f, uniform(name));
     }
 
-    void setUniform(const mat4& mat, const std::string& name) {
-        const int location = getLocation(name);
-        if (location >= 0)
-            glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+    void setUniform(const vec2& v, const std::string_view name) {
+        setUniform(v, uniform(name));
+    }
+
+    void setUniform(const vec3& v, const std::string_view name) {
+        setUniform(v, uniform(name));
+    }
+
+    void setUniform(const vec4& v, const std::string_view name) {
+        setUniform(v, uniform(name));
+    }
+
+    void setUniform(const mat4& mat, const std::string_view name) {
+        setUniform(mat, uniform(name));
+    }
+
+    // Reads the uniform block of the given name from the uniform buffer range
+    // bound to binding, e.g. with glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+    bool bindUniformBlock(const char* const name, const unsigned int binding) {
+        const GLuint index = glGetUniformBlockIndex(shaderProgramId, name);
+        if (index == GL_INVALID_INDEX) {
+            printf("uniform block %s cannot be bound\n", name);
+            return false;
+        }
+        glUniformBlockBinding(shaderProgramId, index, binding);
+        return true;
     }
 
     ~GPUProgram() {
@@ -291,51 +413,315 @@ class GPUProgram {
     }
 };
 
+//---------------------------
+template <class T>
+class VertexArena {
+    //---------------------------
+    // One large VBO holding the vertices of every Geometry<T> as
+    // sub-allocations, and one VAO with the shared vertex format reading it.
+    // Geometries draw with their base offset as first vertex, so switching
+    // between them needs no bind at all. Other VAOs may attach to the arena to
+    // combine its vertices with attributes of their own.
+    unsigned int vao = 0, vbo = 0;  // GPU
+    size_t capacity = 0;            // vertices allocated in the VBO
+    size_t end = 0;                 // vertices in use below this offset
+    std::vector<std::pair<size_t, size_t>> freeBlocks; // offset, count
+    std::vector<unsigned int> attached;               // VAOs reading the VBO
+
+    VertexArena() = default;
+
+    void grow(const size_t minimum) {
+        const size_t newCapacity = std::max({minimum, 2 * capacity,
+                                             static_cast<size_t>(4096)});
+        unsigned int buffer;
+        glCreateBuffers(1, &buffer);
+        glNamedBufferData(buffer,
+                          static_cast<GLsizeiptr>(newCapacity * sizeof(T)),
+                          nullptr, GL_DYNAMIC_DRAW);
+        if (vbo != 0) {
+            glCopyNamedBufferSubData(vbo, buffer, 0, 0,
+                                     static_cast<GLsizeiptr>(end * sizeof(T)));
+            glDeleteBuffers(1, &vbo);
+        }
+        vbo = buffer;
+        capacity = newCapacity;
+        for (const unsigned int a : attached)
+            glVertexArrayVertexBuffer(a, 0, vbo, 0, sizeof(T));
+    }
+
+  public:
+    // The arena of the current context. Intentionally never destroyed, so
+    // Geometry objects outliving static destruction can still free blocks.
+    static VertexArena& get() {
+        static VertexArena* arena = new VertexArena();
+        return *arena;
+    }
+
+    // Sets up attribute 0 of a VAO to read the arena through binding 0
+    void attach(const unsigned int vertexArray) {
+        const int nf = min(static_cast<int>(sizeof(T) / sizeof(float)), 4);
+        glEnableVertexArrayAttrib(vertexArray, 0);
+        glVertexArrayAttribFormat(vertexArray, 0, nf, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vertexArray, 0, 0);
+        glVertexArrayVertexBuffer(vertexArray, 0, vbo, 0, sizeof(T));
+        attached.push_back(vertexArray);
+    }
+
+    void detach(const unsigned int vertexArray) {
+        std::erase(attached, vertexArray);
+    }
+
+    // The shared VAO, created on first use
+    unsigned int vertexArray() {
+        if (vao == 0) {
+            glCreateVertexArrays(1, &vao);
+            attach(vao);
+        }
+        return vao;
+    }
+
+    // Returns the offset of count contiguous vertices, first fit
+    size_t allocate(const size_t count) {
+        for (auto block = freeBlocks.begin(); block != freeBlocks.end();
+             ++block) {
+            if (block->second < count)
+                continue;
+            const size_t offset = block->first;
+            block->first += count;
+            block->second -= count;
+            if (block->second == 0)
+                freeBlocks.erase(block);
+            return offset;
+        }
+        if (end + count > capacity)
+            grow(end + count);
+        end += count;
+        return end - count;
+    }
+
+    // Returns a block to the arena, merging it with its free neighbours
+    void free(const size_t offset, size_t count) {
+        auto next = std::lower_bound(
+            freeBlocks.begin(), freeBlocks.end(), std::pair(offset, count));
+        if (next != freeBlocks.end() && offset + count == next->first) {
+            count += next->second;
+            next = freeBlocks.erase(next);
+        }
+        if (next != freeBlocks.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += count;
+                if (previous->first + previous->second == end) {
+                    end = previous->first;
+                    freeBlocks.erase(previous);
+                }
+                return;
+            }
+        }
+        if (offset + count == end)
+            end = offset;
+        else
+            freeBlocks.insert(next, {offset, count});
+    }
+
+    void upload(const size_t offset, const T* data, const size_t count) {
+        glNamedBufferSubData(vbo, static_cast<GLintptr>(offset * sizeof(T)),
+                             static_cast<GLsizeiptr>(count * sizeof(T)), data);
+    }
+
+    unsigned int buffer() const { return vbo; }
+};
+
 //---------------------------
 template <class T>
 class Geometry {
     //---------------------------
-    unsigned int vao, vbo; // GPU
+    // GPU: a block of the VertexArena, allocated by the first updateGPU
+    size_t base = 0;             // first vertex of the block in the arena
+    size_t capacity = 0;         // vertices in the block
+    unsigned int customVao = 0;  // drawn through this VAO if not zero
   protected:
     std::vector<T> vtx; // CPU
   public:
-    Geometry() {
+    Geometry() = default;
+    std::vector<T>& Vtx() { return vtx; }
+    const std::vector<T>& Vtx() const { return vtx; }
+
+    void updateGPU() { updateGPU(0, vtx.size()); } // CPU -> GPU
+
+    // Only vtx[first, first + count) is uploaded. The block grows by doubling
+    // its capacity; after a reallocation every vertex is uploaded again into
+    // the new block.
+    void updateGPU(const size_t first, size_t count) {
+        VertexArena<T>& arena = VertexArena<T>::get();
+        if (vtx.size() > capacity) {
+            const size_t newCapacity = std::max(vtx.size(), 2 * capacity);
+            const size_t newBase = arena.allocate(newCapacity);
+            if (capacity > 0)
+                arena.free(base, capacity);
+            base = newBase;
+            capacity = newCapacity;
+            arena.upload(base, vtx.data(), vtx.size());
+            return;
+        }
+        if (first >= vtx.size())
+            return; // <-- don't touch [first] if nothing is left
+        count = std::min(count, vtx.size() - first);
+        arena.upload(base + first, vtx.data() + first, count);
+    }
+
+    // Draws through a VAO attached to the VertexArena instead of the shared
+    // one, e.g. to add instanced attributes
+    void setVertexArray(const unsigned int vertexArray) {
+        customVao = vertexArray;
+    }
+
+    unsigned int vertexArray() const {
+        return customVao != 0 ? customVao
+                              : VertexArena<T>::get().vertexArray();
+    }
+
+    void Bind() {
+        glBindVertexArray(vertexArray());
+        glBindBuffer(GL_ARRAY_BUFFER, VertexArena<T>::get().buffer());
+    } // aktiv�l�s
+
+    void Draw(GPUProgram* prog, const int type, const vec3 color) {
+        Draw(prog, type, color, prog->uniform("color"));
+    }
+
+    void Draw(GPUProgram* prog, const int type, const vec3 color,
+              const UniformHandle colorHandle) {
+        Draw(prog, type, color, colorHandle, 0, static_cast<int>(vtx.size()));
+    }
+
+    // Draws vtx[first, first + count), instanceCount times with instancing;
+    // per-instance attributes are set up by the caller on its own VAO (see
+    // setVertexArray) and are read from instance baseInstance on
+    void Draw(GPUProgram* prog, const int type, const vec3 color,
+              const UniformHandle colorHandle, const int first,
+              const int count, const int instanceCount = 1,
+              const unsigned int baseInstance = 0) {
+        if (count > 0 && instanceCount > 0 && capacity > 0) {
+            prog->setUniform(color, colorHandle);
+            glBindVertexArray(vertexArray());
+            const int start = static_cast<int>(base) + first;
+            if (instanceCount == 1 && baseInstance == 0)
+                glDrawArrays(type, start, count);
+            else
+                glDrawArraysInstancedBaseInstance(type, start, count,
+                                                  instanceCount, baseInstance);
+        }
+    }
+
+    virtual ~Geometry() {
+        if (capacity > 0)
+            VertexArena<T>::get().free(base, capacity);
+    }
+};
+
+//---------------------------
+template <class T>
+class StreamGeometry {
+    //---------------------------
+    // Data rewritten every frame. The buffer is a ring of regionCount regions
+    // of capacity elements, mapped persistently and coherently: the CPU writes
+    // one region while the GPU may still read the others, and a fence per
+    // region tells when it can be written again. Nothing is orphaned or
+    // copied by the driver.
+    static constexpr int regionCount = 3;
+    unsigned int vao = 0, vbo = 0; // GPU
+    size_t capacity = 0;           // elements per region
+    T* mapped = nullptr;           // all regions
+    int region = 0;                // the region being written and drawn
+    GLsync fences[regionCount] = {};
+
+    void release() {
+        for (GLsync& fence : fences) {
+            if (fence != nullptr)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (vbo != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glDeleteBuffers(1, &vbo);
+            glDeleteVertexArrays(1, &vao);
+        }
+        vao = vbo = 0;
+        mapped = nullptr;
+    }
+
+  public:
+    StreamGeometry() = default;
+    StreamGeometry(const StreamGeometry&) = delete;
+    StreamGeometry& operator=(const StreamGeometry&) = delete;
+
+    // Makes room for count elements per region. Returns true if the buffer
+    // was recreated, then attributes pointing to it must be set up again.
+    bool reserve(const size_t count) {
+        if (count <= capacity)
+            return false;
+        release();
+        capacity = std::max(count, 2 * capacity);
+        const GLsizeiptr bytes =
+            static_cast<GLsizeiptr>(regionCount * capacity * sizeof(T));
+        constexpr GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
         glGenVertexArrays(1, &vao);
         glBindVertexArray(vao);
         glGenBuffers(1, &vbo);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+        mapped =
+            static_cast<T*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
         glEnableVertexAttribArray(0);
         const int nf = min(static_cast<int>(sizeof(T) / sizeof(float)), 4);
-        glVertexAttribPointer(0, nf, GL_FLOAT, GL_FALSE, 0, NULL);
+        glVertexAttribPointer(0, nf, GL_FLOAT, GL_FALSE, sizeof(T), NULL);
+        region = 0;
+        return true;
     }
-    std::vector<T>& Vtx() { return vtx; }
 
-    void updateGPU() { // CPU -> GPU
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        const GLsizeiptr bytes =
-            static_cast<GLsizeiptr>(vtx.size()) * sizeof(T);
-        const void* data =
-            vtx.empty() ? nullptr : vtx.data(); // <-- don't touch [0] if empty
-        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+    // Moves to the next region and returns it for writing count elements,
+    // once the GPU has finished the draws that read it. Call reserve first
+    // when attributes of other VAOs point to the buffer.
+    T* beginWrite(const size_t count) {
+        reserve(count);
+        region = (region + 1) % regionCount;
+        GLsync& fence = fences[region];
+        if (fence != nullptr) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                             GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        return mapped != nullptr ? mapped + first() : nullptr;
     }
 
-    void Bind() {
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    } // aktiv�l�s
+    // Marks the current region as read by the draws issued so far
+    void endDraws() {
+        if (vbo != 0)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
 
-    void Draw(GPUProgram* prog, const int type, const vec3 color) {
-        if (vtx.size() > 0) {
-            prog->setUniform(color, "color");
+    // Index of the first element of the current region in the buffer, the
+    // first vertex or the base instance of draws reading it
+    int first() const { return static_cast<int>(region * capacity); }
+
+    unsigned int buffer() const { return vbo; }
+
+    // Draws the first count elements of the current region as vertices
+    void Draw(GPUProgram* prog, const int type, const vec3 color,
+              const UniformHandle colorHandle, const int count) {
+        if (count > 0 && vao != 0) {
+            prog->setUniform(color, colorHandle);
             glBindVertexArray(vao);
-            glDrawArrays(type, 0, static_cast<int>(vtx.size()));
+            glDrawArrays(type, first(), count);
         }
     }
 
-    virtual ~Geometry() {
-        glDeleteBuffers(1, &vbo);
-        glDeleteVertexArrays(1, &vao);
-    }
+    ~StreamGeometry() { release(); }
 };
 
 //---------------------------
@@ -418,6 +804,336 @@ class Texture {
     }
 };
 
+//---------------------------
+class TextureBuffer {
+    //---------------------------
+    // RGBA32F texels in a buffer object, read with texelFetch from a
+    // samplerBuffer. GL objects are created by the first update.
+    unsigned int textureId = 0, buffer = 0;
+    size_t capacity = 0; // texels allocated in the buffer
+
+  public:
+    // Uploads texels[first, end) with glBufferSubData. The buffer grows by
+    // doubling its capacity; after a reallocation every texel is uploaded.
+    void update(const std::vector<vec4>& texels, const size_t first) {
+        update(texels, first, texels.size());
+    }
+
+    // Only texels[first, first + count) is uploaded
+    void update(const std::vector<vec4>& texels, size_t first, size_t count) {
+        if (textureId == 0) {
+            glGenTextures(1, &textureId);
+            glGenBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (texels.size() > capacity) {
+            capacity = std::max(texels.size(), 2 * capacity);
+            glBufferData(GL_TEXTURE_BUFFER,
+                         static_cast<GLsizeiptr>(capacity * sizeof(vec4)),
+                         nullptr, GL_DYNAMIC_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textureId);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+            first = 0;
+            count = texels.size();
+        }
+        if (first >= texels.size())
+            return;
+        count = std::min(count, texels.size() - first);
+        glBufferSubData(GL_TEXTURE_BUFFER,
+                        static_cast<GLintptr>(first * sizeof(vec4)),
+                        static_cast<GLsizeiptr>(count * sizeof(vec4)),
+                        texels.data() + first);
+    }
+
+    void Bind(const int textureUnit) {
+        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, textureId);
+    }
+
+    ~TextureBuffer() {
+        if (textureId > 0) {
+            glDeleteTextures(1, &textureId);
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+};
+
+//---------------------------
+class Profiler {
+    //---------------------------
+    // Scoped CPU and GPU timing zones of the main thread, grouped by frame.
+    // GPU zones bracket their commands with GL_TIMESTAMP queries. The query
+    // sets form a ring: the oldest frames are read as soon as their results
+    // are available, and a frame still pending is only read as far as it is
+    // ready when the ring is full, so profiling never stalls the pipeline.
+    // Disabled, a zone costs one branch and issues no GL calls.
+  public:
+    static constexpr size_t gpuLatency = 4;     // query sets in the ring
+    static constexpr size_t historySize = 1000; // resolved frames kept
+
+    struct Zone {
+        const char* name;
+        double begin, end = 0;             // CPU, seconds
+        int query = -1;                    // first of its two queries
+        uint64_t gpuBegin = 0, gpuEnd = 0; // GPU timestamps in ns, 0: none
+    };
+
+    struct Frame {
+        double begin = 0, end = 0;
+        size_t querySet = 0;
+        std::vector<Zone> zones;
+    };
+
+  private:
+    bool enabled = false, gpuEnabled = false;
+    std::chrono::steady_clock::time_point origin =
+        std::chrono::steady_clock::now();
+    Frame current;
+    std::deque<Frame> inFlight; // ended, GPU results not read yet
+    std::deque<Frame> history;  // resolved, oldest first
+    std::vector<unsigned int> queries[gpuLatency];
+    size_t queriesUsed = 0; // of the set of the current frame
+
+    Profiler() = default;
+
+    double now() const {
+        return std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - origin)
+            .count();
+    }
+
+    // True once every GPU result of the frame can be read. Timestamps
+    // complete in order, so the last query of the frame decides.
+    bool ready(const Frame& frame) const {
+        for (auto zone = frame.zones.rbegin(); zone != frame.zones.rend();
+             ++zone) {
+            if (zone->query < 0)
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[frame.querySet][zone->query + 1],
+                               GL_QUERY_RESULT_AVAILABLE, &available);
+            return available != 0;
+        }
+        return true;
+    }
+
+    // Reads the GPU timestamps of a frame whose results are ready
+    void resolve(Frame& frame) {
+        for (Zone& zone : frame.zones) {
+            if (zone.query < 0)
+                continue;
+            const unsigned int* q = &queries[frame.querySet][zone.query];
+            GLint available = 0;
+            glGetQueryObjectiv(q[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue; // dropped rather than waited for
+            glGetQueryObjectui64v(q[0], GL_QUERY_RESULT, &zone.gpuBegin);
+            glGetQueryObjectui64v(q[1], GL_QUERY_RESULT, &zone.gpuEnd);
+        }
+    }
+
+    static double percentile(std::vector<double>& values, const double p) {
+        std::sort(values.begin(), values.end());
+        const size_t rank = static_cast<size_t>(p * (values.size() - 1));
+        return values[rank];
+    }
+
+  public:
+    // The profiler of the main thread. Intentionally never destroyed, like
+    // VertexArena, so no GL call runs after the context is gone.
+    static Profiler& get() {
+        static Profiler* profiler = new Profiler();
+        return *profiler;
+    }
+
+    // Starts a new recording, dropping the frames of the previous one
+    void setEnabled(const bool cpu, const bool gpu) {
+        enabled = cpu;
+        gpuEnabled = cpu && gpu;
+        current = Frame();
+        inFlight.clear();
+        history.clear();
+        queriesUsed = 0;
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    void beginFrame() {
+        if (enabled)
+            current.begin = now();
+    }
+
+    // Queues the frame for its GPU results and reads the oldest frames whose
+    // results are available, and the oldest one in any case once its query
+    // set is the one the next frame reuses
+    void endFrame() {
+        if (!enabled)
+            return;
+        current.end = now();
+        const size_t next = (current.querySet + 1) % gpuLatency;
+        inFlight.push_back(std::move(current));
+        while (!inFlight.empty() && (inFlight.size() >= gpuLatency ||
+                                     ready(inFlight.front()))) {
+            resolve(inFlight.front());
+            history.push_back(std::move(inFlight.front()));
+            inFlight.pop_front();
+            if (history.size() > historySize)
+                history.pop_front();
+        }
+        current = Frame();
+        current.querySet = next;
+        queriesUsed = 0;
+    }
+
+    // Zones are recorded into the current frame; name must outlive the
+    // profiler, e.g. a string literal. Returns -1 if disabled.
+    int beginZone(const char* name, const bool gpu) {
+        if (!enabled)
+            return -1;
+        Zone zone{name, now()};
+        if (gpu && gpuEnabled) {
+            std::vector<unsigned int>& set = queries[current.querySet];
+            if (queriesUsed + 2 > set.size()) {
+                const size_t old = set.size();
+                set.resize(std::max<size_t>(2 * old, 32));
+                glGenQueries(static_cast<GLsizei>(set.size() - old),
+                             set.data() + old);
+            }
+            zone.query = static_cast<int>(queriesUsed);
+            queriesUsed += 2;
+            glQueryCounter(set[zone.query], GL_TIMESTAMP);
+        }
+        current.zones.push_back(zone);
+        return static_cast<int>(current.zones.size()) - 1;
+    }
+
+    void endZone(const int index) {
+        if (index < 0 || index >= static_cast<int>(current.zones.size()))
+            return; // recording restarted inside the zone
+        Zone& zone = current.zones[index];
+        if (zone.query >= 0)
+            glQueryCounter(queries[current.querySet][zone.query + 1],
+                           GL_TIMESTAMP);
+        zone.end = now();
+    }
+
+    const std::deque<Frame>& frames() const { return history; }
+
+    // Chrome trace event JSON (chrome://tracing, Perfetto) of the resolved
+    // frames: CPU zones on thread 1, GPU zones on thread 2. GPU timestamps
+    // are placed relative to the first GPU zone of their frame, which is
+    // aligned with its CPU begin.
+    bool writeTrace(const std::string& path) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            printf("Cannot write %s\n", path.c_str());
+            return false;
+        }
+        fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+                      "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                      "\"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n"
+                      "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                      "\"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+        const auto event = [file](const char* name, const int tid,
+                                  const double begin, const double end) {
+            fprintf(file,
+                    ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                    "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    name, tid, begin * 1e6, (end - begin) * 1e6);
+        };
+        for (const Frame& frame : history) {
+            event("Frame", 1, frame.begin, frame.end);
+            const Zone* anchor = nullptr;
+            for (const Zone& zone : frame.zones) {
+                event(zone.name, 1, zone.begin, zone.end);
+                if (zone.gpuEnd == 0)
+                    continue;
+                if (!anchor)
+                    anchor = &zone;
+                const auto cpuTime = [anchor](const uint64_t gpu) {
+                    return anchor->begin +
+                           (static_cast<double>(gpu) -
+                            static_cast<double>(anchor->gpuBegin)) * 1e-9;
+                };
+                event(zone.name, 2, cpuTime(zone.gpuBegin),
+                      cpuTime(zone.gpuEnd));
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+
+    // Median, 90th and 99th percentile of the per-frame totals of every
+    // zone, in ms, over the resolved frames
+    void printSummary(FILE* out) const {
+        std::vector<const char*> names;
+        std::unordered_map<std::string_view, std::vector<double>> cpu, gpu;
+        std::vector<double> frameTimes;
+        for (const Frame& frame : history) {
+            frameTimes.push_back((frame.end - frame.begin) * 1e3);
+            std::unordered_map<std::string_view, double> cpuSum, gpuSum;
+            std::unordered_map<std::string_view, bool> gpuMissing;
+            for (const Zone& zone : frame.zones) {
+                if (!cpu.contains(zone.name)) {
+                    names.push_back(zone.name);
+                    cpu[zone.name];
+                }
+                cpuSum[zone.name] += (zone.end - zone.begin) * 1e3;
+                if (zone.query >= 0 && zone.gpuEnd == 0)
+                    gpuMissing[zone.name] = true;
+                else if (zone.query >= 0)
+                    gpuSum[zone.name] += (zone.gpuEnd - zone.gpuBegin) * 1e-6;
+            }
+            for (const auto& [name, ms] : cpuSum)
+                cpu[name].push_back(ms);
+            for (const auto& [name, ms] : gpuSum)
+                if (!gpuMissing[name])
+                    gpu[name].push_back(ms);
+        }
+        fprintf(out, "%-24s %8s %8s %8s %8s %8s %8s   (ms, %zu frames)\n",
+                "zone", "cpu p50", "p90", "p99", "gpu p50", "p90", "p99",
+                history.size());
+        const auto row = [out](const char* name, std::vector<double>& c,
+                               std::vector<double>& g) {
+            fprintf(out, "%-24s", name);
+            for (std::vector<double>* values : {&c, &g}) {
+                if (values->empty()) {
+                    fprintf(out, " %8s %8s %8s", "-", "-", "-");
+                    continue;
+                }
+                const double p50 = percentile(*values, 0.5);
+                const double p90 = percentile(*values, 0.9);
+                const double p99 = percentile(*values, 0.99);
+                fprintf(out, " %8.3f %8.3f %8.3f", p50, p90, p99);
+            }
+            fprintf(out, "\n");
+        };
+        std::vector<double> none;
+        if (!frameTimes.empty())
+            row("Frame", frameTimes, none);
+        for (const char* name : names)
+            row(name, cpu[name], gpu[name]);
+    }
+};
+
+//---------------------------
+class ProfileZone {
+    //---------------------------
+    // Times the enclosing scope as a zone of the current frame, on the GPU
+    // too if gpu is set
+    int index;
+
+  public:
+    explicit ProfileZone(const char* name, const bool gpu = false)
+        : index(Profiler::get().beginZone(name, gpu)) {}
+
+    ~ProfileZone() { Profiler::get().endZone(index); }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
 enum MouseButton { MOUSE_LEFT, MOUSE_MIDDLE, MOUSE_RIGHT };
 
 enum SpecialKeys {
@@ -445,6 +1161,15 @@ class glApp {
 
     void refreshScreen(); // Ablak �rv�nytelen�t�se
 
+    // Fixed step physics: onFixedStep is called with dt, at most maxSubsteps
+    // times per frame, instead of onTimeElapsed; the rest of a long frame is
+    // dropped. dt <= 0 restores one variable onTimeElapsed interval per frame.
+    void setFixedTimeStep(float dt, int maxSubsteps = 10);
+
+    // Fraction of a fixed step elapsed since the last physics state, in
+    // [0, 1), for interpolating it in onDisplay. 1 without fixed steps.
+    float interpolationAlpha() const;
+
     // Esem�nykezel�k
     virtual void onInitialization() {}    // Inicializ�ci�
     virtual void onDisplay() {}           // Ablak �rv�nytelen
@@ -460,5 +1185,13 @@ class glApp {
 
     // Telik az id�
     virtual void onTimeElapsed(float startTime, float endTime) {}
+
+    // One physics step of the length set by setFixedTimeStep. The step is
+    // passed as is, the absolute time being too coarse as float after hours.
+    virtual void onFixedStep(float dt) {}
+
+    // Is anything moving? If not and no redraw is pending, the framework
+    // sleeps until the next event instead of polling and stepping time.
+    virtual bool isAnimating() const { return true; }
 };
 